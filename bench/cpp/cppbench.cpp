@@ -0,0 +1,208 @@
+/*
+ * Copyright 2024 Massimiliano Cialdi
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * cppbench: C++ front-end (ymodem::Receiver) versus C callbacks
+ *
+ * usage: cppbench
+ *
+ * the same batch (one file) framed in memory is received again and again through
+ * the same loopback transport (bench/port/loopback.h), reading no more than chunk
+ * bytes per call, by ymodem_receive() with C callbacks and by ymodem::Receiver with
+ * policy types. Prints CSV: api,chunk,bytes,ns_per_byte
+ */
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include "ymodem.hpp"
+#include "loopback.h"
+
+namespace
+{
+
+constexpr std::size_t FILE_SIZE = 1024 * 1024;
+
+/* minimum time spent on each measure */
+constexpr std::uint64_t MIN_NS = 100000000ULL;
+
+/* measures taken, the fastest one is reported (the others have been disturbed) */
+constexpr int MEASURES = 5;
+
+std::uint8_t stream[LOOPBACK_BATCH_SIZE(FILE_SIZE)];
+std::uint8_t file[FILE_SIZE];
+std::uint8_t received[FILE_SIZE];
+
+loopback_t lb;
+
+std::uint64_t now_ns()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (std::uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* policy types over the loopback */
+struct LoopbackTransport
+{
+    std::int32_t read(std::uint8_t *buf, std::size_t len, std::uint32_t toutMs)
+    {
+        return loopback_getBytes(&lb, buf, len, toutMs);
+    }
+
+    void write(const std::uint8_t *buf, std::size_t len)
+    {
+        loopback_putBytes(&lb, buf, len);
+    }
+
+    void flush()
+    {
+        loopback_flush(&lb);
+    }
+};
+
+struct RamStorage
+{
+    std::size_t maxFileSize()
+    {
+        return FILE_SIZE;
+    }
+
+    bool open(const char *filename)
+    {
+        lb.fileLen = 0;
+        return true;
+    }
+
+    bool write(const std::uint8_t *data, std::size_t len)
+    {
+        return 0 == loopback_processData(&lb, data, len);
+    }
+
+    void close()
+    {
+    }
+};
+
+/* C callbacks */
+std::size_t usr_maxFileSize(void *param)
+{
+    return FILE_SIZE;
+}
+
+std::int32_t usr_ReceiveStart(void *param, const char *filename)
+{
+    lb.fileLen = 0;
+    return 0;
+}
+
+std::int32_t usr_ReceiveEnd(void *param)
+{
+    return 0;
+}
+
+/* receive the whole batch once, true on success */
+template <class Receive>
+bool receive(Receive &rx)
+{
+    lb.rdIdx = 0;
+    lb.replies = 0;
+    return rx();
+}
+
+template <class Receive>
+bool bench(Receive &rx, const char *api, std::size_t chunk)
+{
+    std::uint64_t iterations = 1;
+    std::uint64_t ns;
+
+    lb.chunk = chunk;
+    if(!receive(rx) || (FILE_SIZE != lb.fileLen) || (0 != std::memcmp(file, received, FILE_SIZE)))
+    {
+        std::fprintf(stderr, "%s: batch not received\n", api);
+        return false;
+    }
+
+    /* double the iterations until the measure is long enough */
+    while(1)
+    {
+        std::uint64_t t0 = now_ns();
+        for(std::uint64_t i=0;i<iterations;i++)
+        {
+            receive(rx);
+        }
+        ns = now_ns() - t0;
+        if(ns >= MIN_NS)
+        {
+            break;
+        }
+        iterations *= 2;
+    }
+    for(int m=1;m<MEASURES;m++)
+    {
+        std::uint64_t t0 = now_ns();
+        for(std::uint64_t i=0;i<iterations;i++)
+        {
+            receive(rx);
+        }
+        std::uint64_t t = now_ns() - t0;
+        if(t < ns)
+        {
+            ns = t;
+        }
+    }
+    std::printf("%s,%zu,%zu,%.3f\n", api, chunk, FILE_SIZE, (double)ns / (iterations * FILE_SIZE));
+    return true;
+}
+
+} // namespace
+
+int main()
+{
+    static const std::size_t chunks[] = {1, 16, 1029};
+    static staticYmodem_t staticYmBuff;
+    static LoopbackTransport transport;
+    static RamStorage storage;
+    static ymodem::Receiver<LoopbackTransport, RamStorage> receiver(transport, storage);
+
+    loopback_fill(file, FILE_SIZE);
+    lb.stream = stream;
+    lb.streamLen = loopback_frame_batch(stream, file, FILE_SIZE);
+    lb.file = received;
+
+    ymodem_desc_t *ymHdl = ymodem_init(&staticYmBuff, &lb,
+            usr_maxFileSize,
+            usr_ReceiveStart,
+            loopback_processData,
+            usr_ReceiveEnd,
+            nullptr,
+            loopback_getBytes,
+            nullptr,
+            loopback_putBytes,
+            loopback_flush);
+    auto cRx = [ymHdl]() { return 0 == ymodem_receive(ymHdl); };
+    auto cppRx = []() { return receiver.receive(); };
+
+    std::printf("api,chunk,bytes,ns_per_byte\n");
+    for(std::size_t chunk : chunks)
+    {
+        if(!bench(cRx, "c-callbacks", chunk) || !bench(cppRx, "cpp-receiver", chunk))
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
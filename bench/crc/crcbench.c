@@ -0,0 +1,104 @@
+/*
+ * Copyright 2024 Massimiliano Cialdi
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * crcbench: speed of a crc backend
+ *
+ * usage: crcbench-<backend> <backend name> <text size> <rodata size>
+ *
+ * prints one CSV line (without header) per input size:
+ *   backend,input,bytes,ns_per_byte,cycles_per_byte,text,rodata
+ * inputs named "+copy" measure crc16_xmodem_copy_update() into a second buffer.
+ * cycles are TSC cycles (x86 only, 0 elsewhere), sizes are those of the
+ * backend object file, measured by the makefile.
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include "crc16-xmodem.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define cycles() __rdtsc()
+#else
+#define cycles() 0ULL
+#endif
+
+#define BULK_SIZE (1024*1024)
+
+/* minimum time spent on each measure */
+#define MIN_NS (200000000ULL)
+
+static uint8_t buf[BULK_SIZE];
+static uint8_t dst[BULK_SIZE];
+
+static volatile crc16_xmodem_t sink; /* keeps the results alive */
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void bench(const char *backend, const char *input, size_t len, int copy, const char *text, const char *rodata)
+{
+    uint64_t iterations = 1;
+    uint64_t ns, cyc;
+
+    /* double the iterations until the measure is long enough */
+    while (1) {
+        crc16_xmodem_t crc = crc16_xmodem_init();
+        uint64_t c0 = cycles();
+        uint64_t t0 = now_ns();
+        for (uint64_t i = 0; i < iterations; i++) {
+            if (copy) {
+                crc = crc16_xmodem_copy_update(crc, dst, buf, len);
+            } else {
+                crc = crc16_xmodem_update(crc, buf, len);
+            }
+        }
+        sink = crc16_xmodem_finalize(crc);
+        ns = now_ns() - t0;
+        cyc = cycles() - c0;
+        if (ns >= MIN_NS) {
+            break;
+        }
+        iterations *= 2;
+    }
+
+    double bytes = (double)iterations * len;
+    printf("%s,%s,%zu,%.3f,%.3f,%s,%s\n", backend, input, len, ns / bytes, cyc / bytes, text, rodata);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 4) {
+        fprintf(stderr, "usage: %s <backend name> <text size> <rodata size>\n", argv[0]);
+        return 1;
+    }
+    srand(1);
+    for (size_t i = 0; i < sizeof(buf); i++) {
+        buf[i] = (uint8_t)rand();
+    }
+
+    bench(argv[1], "128", 128, 0, argv[2], argv[3]);
+    bench(argv[1], "1k", 1024, 0, argv[2], argv[3]);
+    bench(argv[1], "bulk", BULK_SIZE, 0, argv[2], argv[3]);
+    bench(argv[1], "1k+copy", 1024, 1, argv[2], argv[3]);
+    return 0;
+}
@@ -0,0 +1,283 @@
+/*
+ * Copyright 2024 Massimiliano Cialdi
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * linkbench: end to end throughput over simulated links
+ *
+ * usage: linkbench [seed]
+ *
+ * ymodem_send() and ymodem_receive() transfer a file to each other over a linksim
+ * link, for every link profile, receiver configuration and file size. Times are
+ * virtual (see linksim.h), so the results only depend on the protocol, the link and
+ * the seed. Prints CSV on stdout:
+ *   profile,config,bytes,result,seconds,goodput_Bps,line_Bps,efficiency,retries
+ * efficiency is goodput over line rate, a failed session counts as no byte.
+ * A session whose blocks get through intact less than half the time (big blocks on a
+ * noisy link) is expected to fail: its failure is reported as xfail and doesn't count
+ * in the exit status, 1 if any other session failed.
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "ymodem.h"
+#include "linksim.h"
+
+#define MAX_FILE_SIZE (1024*1024)
+
+/* a session taking longer than this is given up */
+#define LIMIT_NS (3ull * 3600 * 1000000000)
+
+/* receiver configurations: negotiated block size and window */
+typedef struct config
+{
+    const char *name;
+    size_t blockSize;
+    uint8_t window;
+}config_t;
+
+typedef struct sender
+{
+    linksim_end_t end; /* first: callbacks get the sender as their link end */
+    ymodem_tx_desc_t *ymTxHdl;
+    const uint8_t *file;
+    size_t fileSize;
+    size_t ofs;
+    int sent;
+    int result;
+}sender_t;
+
+typedef struct receiver
+{
+    linksim_end_t end; /* first: callbacks get the receiver as their link end */
+    ymodem_desc_t *ymHdl;
+    uint8_t *file;
+    size_t fileLen;
+    int result;
+    uint64_t endNs; /* virtual time the session is over */
+}receiver_t;
+
+static const linksim_profile_t profiles[] =
+{
+    /* name,            rate,    latency, ber,  drop, dup,  garbage */
+    { "usb",            1000000, 100,     0,    0,    0,    0 },
+    { "uart115200",     11520,   1000,    0,    0,    0,    0 },
+    { "uart115200-ber", 11520,   1000,    1e-5, 0,    0,    0 },
+    { "radio9600",      960,     20000,   1e-5, 1e-5, 0,    1e-5 },
+    { "cellular",       50000,   150000,  1e-6, 1e-6, 1e-6, 1e-6 },
+};
+
+static const config_t configs[] =
+{
+    { "1k", 1024, 1 },
+    { "1k-w8", 1024, 8 },
+    { "32k-w8", 32768, 8 },
+};
+
+static const size_t sizes[] = { 1024, 64 * 1024, MAX_FILE_SIZE };
+
+static staticYmodem_t staticYmBuff;
+static staticYmodemTx_t staticYmTxBuff;
+static uint8_t file[MAX_FILE_SIZE];
+static uint8_t received[MAX_FILE_SIZE];
+
+static int32_t tx_SendStart(sender_t *tx, char *filename, size_t filenameSz, size_t *filesize)
+{
+    if(tx->sent)
+    {
+        return 1; /* end of batch */
+    }
+    tx->sent = 1;
+    tx->ofs = 0;
+    strncpy(filename, "bench.bin", filenameSz);
+    *filesize = tx->fileSize;
+    return 0;
+}
+
+static int32_t tx_ReadData(sender_t *tx, uint8_t *buffer, size_t buffSz)
+{
+    size_t n = tx->fileSize - tx->ofs;
+
+    n = (n < buffSz) ? n : buffSz;
+    memcpy(buffer, &tx->file[tx->ofs], n);
+    tx->ofs += n;
+    return n;
+}
+
+static int32_t tx_SendEnd(sender_t *tx)
+{
+    return 0;
+}
+
+static void tx_run(void *param)
+{
+    sender_t *tx = param;
+
+    tx->result = ymodem_send(tx->ymTxHdl);
+}
+
+static size_t rx_maxFileSize(receiver_t *rx)
+{
+    return MAX_FILE_SIZE;
+}
+
+static int32_t rx_ReceiveStart(receiver_t *rx, const char *filename)
+{
+    rx->fileLen = 0;
+    return 0;
+}
+
+static int32_t rx_ProcessData(receiver_t *rx, const uint8_t *buffer, size_t buffSz)
+{
+    if(rx->fileLen + buffSz > MAX_FILE_SIZE)
+    {
+        return -1;
+    }
+    memcpy(&rx->file[rx->fileLen], buffer, buffSz);
+    rx->fileLen += buffSz;
+    return 0;
+}
+
+static int32_t rx_ReceiveEnd(receiver_t *rx)
+{
+    return 0;
+}
+
+static void rx_run(void *param)
+{
+    receiver_t *rx = param;
+
+    rx->result = ymodem_receive(rx->ymHdl);
+    rx->endNs = rx->end.sim->now;
+}
+
+/* data the same run after run (xorshift) */
+static void fill(uint8_t *data, size_t size)
+{
+    uint64_t x = 88172645463325252ULL;
+
+    for(size_t i=0;i<size;i++)
+    {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        data[i] = x;
+    }
+}
+
+/* chance of a frame (header, data block, crc) of len bytes to arrive intact */
+static double frame_intact(const linksim_profile_t *profile, size_t len)
+{
+    return pow(1.0 - profile->ber, 8.0 * len) * pow(1.0 - profile->drop - profile->dup - profile->garbage, len);
+}
+
+/* one session, one CSV line: 0 if the file got through (or failed as expected), 1 if the session failed, -1 if it couldn't run */
+static int session(const linksim_profile_t *profile, const config_t *config, size_t size, uint64_t seed)
+{
+    sender_t tx = { .result = -1 };
+    receiver_t rx = { .result = -1 };
+    linksim_t sim;
+    ymodem_timing_t timing = YM_TIMING_DEFAULT;
+
+    tx.end.run = tx_run;
+    tx.end.param = &tx;
+    tx.file = file;
+    tx.fileSize = size;
+    tx.ymTxHdl = ymodem_tx_init(&staticYmTxBuff, &tx,
+            (ymodem_sendStart_t)tx_SendStart,
+            (ymodem_readData_t)tx_ReadData,
+            (ymodem_sendEnd_t)tx_SendEnd,
+            linksim_getByte,
+            NULL,
+            linksim_putByte,
+            NULL,
+            linksim_flush);
+
+    rx.end.run = rx_run;
+    rx.end.param = &rx;
+    rx.file = received;
+    rx.ymHdl = ymodem_init(&staticYmBuff, &rx,
+            (ymodem_maxFileSize_t)rx_maxFileSize,
+            (ymodem_receiveStart_t)rx_ReceiveStart,
+            (ymodem_processData_t)rx_ProcessData,
+            (ymodem_receiveEnd_t)rx_ReceiveEnd,
+            linksim_getByte,
+            NULL,
+            linksim_putByte,
+            NULL,
+            linksim_flush);
+    if((NULL == tx.ymTxHdl) || (NULL == rx.ymHdl))
+    {
+        fprintf(stderr, "initialization failed\n");
+        return -1;
+    }
+    ymodem_set_block_size(rx.ymHdl, config->blockSize);
+    ymodem_set_window(rx.ymHdl, config->window);
+    ymodem_set_timing(rx.ymHdl, &timing, linksim_getTime);
+    ymodem_tx_set_timing(tx.ymTxHdl, &timing, linksim_getTime);
+
+    if(0 != linksim_init(&sim, profile, seed, &rx.end, &tx.end))
+    {
+        fprintf(stderr, "out of memory\n");
+        return -1;
+    }
+    int ok = (0 == linksim_run(&sim, LIMIT_NS)) && (0 == rx.result) && (0 == tx.result) &&
+             (size == rx.fileLen) && (0 == memcmp(file, received, size));
+    uint64_t ns = ok ? rx.endNs : sim.now;
+    linksim_free(&sim);
+
+    ymodem_stats_t st;
+    ymodem_get_stats(rx.ymHdl, &st);
+    double seconds = ns / 1e9;
+    double goodput = (ok && (ns > 0)) ? size / seconds : 0.0;
+    size_t blockSize = (size <= 1024) ? 1024 : config->blockSize; /* the frame the data is sent in */
+    int xfail = frame_intact(profile, blockSize + 5) < 0.5;
+    printf("%s,%s,%zu,%s,%.3f,%.0f,%u,%.3f,%u\n", profile->name, config->name, size, ok ? "ok" : xfail ? "xfail" : "failed",
+            seconds, goodput, profile->rate, goodput / profile->rate, st.retries);
+    return (ok || xfail) ? 0 : 1;
+}
+
+int main(int argc, char *argv[])
+{
+    uint64_t seed = (argc > 1) ? strtoull(argv[1], NULL, 0) : 1;
+    int failed = 0;
+    int sessions = 0;
+
+    fill(file, sizeof(file));
+    printf("profile,config,bytes,result,seconds,goodput_Bps,line_Bps,efficiency,retries\n");
+    for(size_t p=0;p<sizeof(profiles)/sizeof(profiles[0]);p++)
+    {
+        for(size_t c=0;c<sizeof(configs)/sizeof(configs[0]);c++)
+        {
+            for(size_t s=0;s<sizeof(sizes)/sizeof(sizes[0]);s++)
+            {
+                int ret = session(&profiles[p], &configs[c], sizes[s], seed);
+                if(ret < 0)
+                {
+                    return 1;
+                }
+                failed += ret;
+                sessions++;
+            }
+        }
+    }
+    if(0 != failed) /* every row is printed anyway, the exit status tells a run with failures */
+    {
+        fprintf(stderr, "%d of %d sessions failed\n", failed, sessions);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,294 @@
+/*
+ * Copyright 2024 Massimiliano Cialdi
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "linksim.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+/* stack of an end: the ymodem handles are not on it */
+#define END_STACK_SIZE (256*1024)
+
+/* bytes in flight a direction starts with, it grows as needed */
+#define DIR_INITIAL_CAP (4096)
+
+/* link being run, for the entry point of the ends */
+static linksim_t *running;
+
+/* spread the bits of a small seed, xorshift would start with tiny values */
+static uint64_t rng_seed(uint64_t seed)
+{
+    uint64_t z = seed + 0x9E3779B97F4A7C15ull;
+
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    z ^= z >> 31;
+    return z ? z : 1;
+}
+
+static uint64_t rng_next(uint64_t *state)
+{
+    uint64_t x = *state;
+
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+/* uniform in (0, 1] */
+static double rng_uniform(uint64_t *state)
+{
+    return ((rng_next(state) >> 11) + 1) * (1.0 / 9007199254740992.0);
+}
+
+/* events before the next one, for independent events of probability p: the gap is geometric */
+static uint64_t next_gap(uint64_t *state, double p)
+{
+    if(p <= 0.0)
+    {
+        return UINT64_MAX;
+    }
+    return (uint64_t)(-log(rng_uniform(state)) / p);
+}
+
+/* true if the event happens on this byte, then the next gap is drawn */
+static int dir_event(linksim_dir_t *d, uint64_t *gap, double p)
+{
+    if(0 != *gap)
+    {
+        (*gap)--;
+        return 0;
+    }
+    *gap = next_gap(&d->rng, p);
+    return 1;
+}
+
+static int dir_init(linksim_dir_t *d, const linksim_profile_t *profile, uint64_t seed)
+{
+    memset(d, 0, sizeof(*d));
+    d->cap = DIR_INITIAL_CAP;
+    d->at = malloc(d->cap * sizeof(d->at[0]));
+    d->data = malloc(d->cap);
+    if((NULL == d->at) || (NULL == d->data))
+    {
+        return -1;
+    }
+    d->rng = rng_seed(seed);
+    d->toError = next_gap(&d->rng, profile->ber);
+    d->toDrop = next_gap(&d->rng, profile->drop);
+    d->toDup = next_gap(&d->rng, profile->dup);
+    d->toGarbage = next_gap(&d->rng, profile->garbage);
+    return 0;
+}
+
+/* queue a byte arriving at the other end at time at (ns) */
+static void dir_push(linksim_dir_t *d, uint64_t at, uint8_t c)
+{
+    if(d->tail - d->head == d->cap) /* full: double it, bytes in flight moved to the start */
+    {
+        size_t cap = d->cap * 2;
+        uint64_t *newAt = malloc(cap * sizeof(newAt[0]));
+        uint8_t *newData = malloc(cap);
+        if((NULL == newAt) || (NULL == newData))
+        {
+            abort();
+        }
+        for(size_t i=0;i<d->cap;i++)
+        {
+            newAt[i] = d->at[(d->head + i) & (d->cap - 1)];
+            newData[i] = d->data[(d->head + i) & (d->cap - 1)];
+        }
+        free(d->at);
+        free(d->data);
+        d->at = newAt;
+        d->data = newData;
+        d->head = 0;
+        d->tail = d->cap;
+        d->cap = cap;
+    }
+    d->at[d->tail & (d->cap - 1)] = at;
+    d->data[d->tail & (d->cap - 1)] = c;
+    d->tail++;
+}
+
+/* time (ns) of the first byte in flight, UINT64_MAX if none */
+static uint64_t dir_next(const linksim_dir_t *d)
+{
+    return (d->head != d->tail) ? d->at[d->head & (d->cap - 1)] : UINT64_MAX;
+}
+
+static void end_main(int idx)
+{
+    linksim_end_t *e = running->end[idx];
+
+    e->run(e->param);
+    e->done = 1; /* back to linksim_run() through uc_link */
+}
+
+int linksim_init(linksim_t *sim, const linksim_profile_t *profile, uint64_t seed, linksim_end_t *a, linksim_end_t *b)
+{
+    memset(sim, 0, sizeof(*sim));
+    sim->profile = profile;
+    sim->byteNs = 1000000000ull / profile->rate;
+    if((0 != dir_init(&sim->dir[0], profile, seed * 2)) || (0 != dir_init(&sim->dir[1], profile, seed * 2 + 1)))
+    {
+        return -1;
+    }
+    sim->end[0] = a;
+    sim->end[1] = b;
+    for(int i=0;i<2;i++)
+    {
+        linksim_end_t *e = sim->end[i];
+        e->sim = sim;
+        e->out = &sim->dir[i];
+        e->in = &sim->dir[1 - i];
+        e->wakeAt = 0;
+        e->done = 0;
+        e->stack = malloc(END_STACK_SIZE);
+        if(NULL == e->stack)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int linksim_run(linksim_t *sim, uint64_t limitNs)
+{
+    running = sim;
+    for(int i=0;i<2;i++)
+    {
+        linksim_end_t *e = sim->end[i];
+        getcontext(&e->ctx);
+        e->ctx.uc_stack.ss_sp = e->stack;
+        e->ctx.uc_stack.ss_size = END_STACK_SIZE;
+        e->ctx.uc_link = &sim->main;
+        makecontext(&e->ctx, (void (*)(void))end_main, 1, i);
+    }
+
+    while(!sim->end[0]->done || !sim->end[1]->done)
+    {
+        /* both ends wait: resume the one whose bytes arrive or whose read expires first */
+        linksim_end_t *next = NULL;
+        uint64_t wake = UINT64_MAX;
+        for(int i=0;i<2;i++)
+        {
+            linksim_end_t *e = sim->end[i];
+            if(e->done)
+            {
+                continue;
+            }
+            uint64_t t = dir_next(e->in);
+            t = (t < e->wakeAt) ? t : e->wakeAt;
+            if(t < wake)
+            {
+                wake = t;
+                next = e;
+            }
+        }
+        if(wake > limitNs)
+        {
+            return -1; /* the ends are abandoned where they wait */
+        }
+        if(wake > sim->now)
+        {
+            sim->now = wake;
+        }
+        swapcontext(&sim->main, &next->ctx);
+    }
+    return 0;
+}
+
+void linksim_free(linksim_t *sim)
+{
+    for(int i=0;i<2;i++)
+    {
+        free(sim->dir[i].at);
+        free(sim->dir[i].data);
+        free(sim->end[i]->stack);
+        sim->end[i]->stack = NULL;
+    }
+}
+
+int linksim_getByte(void *param, uint32_t tout)
+{
+    linksim_end_t *e = (linksim_end_t *)param;
+    linksim_t *sim = e->sim;
+    linksim_dir_t *d = e->in;
+    uint64_t deadline = sim->now + (uint64_t)tout * 1000000;
+
+    while(1)
+    {
+        if(dir_next(d) <= sim->now)
+        {
+            return d->data[d->head++ & (d->cap - 1)];
+        }
+        if(sim->now >= deadline)
+        {
+            return -1;
+        }
+        e->wakeAt = deadline;
+        swapcontext(&e->ctx, &sim->main);
+    }
+}
+
+void linksim_putByte(void *param, uint8_t c)
+{
+    linksim_end_t *e = (linksim_end_t *)param;
+    linksim_t *sim = e->sim;
+    const linksim_profile_t *p = sim->profile;
+    linksim_dir_t *d = e->out;
+
+    /* serialized after the bytes before it, then on the line for the latency */
+    d->txEnd = ((d->txEnd > sim->now) ? d->txEnd : sim->now) + sim->byteNs;
+    uint64_t at = d->txEnd + (uint64_t)p->latencyUs * 1000;
+
+    unsigned pos = 0;
+    while(d->toError < 8 - pos)
+    {
+        pos += d->toError;
+        c ^= 1 << pos;
+        pos++;
+        d->toError = next_gap(&d->rng, p->ber);
+    }
+    d->toError -= 8 - pos;
+
+    if(dir_event(d, &d->toDrop, p->drop))
+    {
+        return;
+    }
+    dir_push(d, at, c);
+    if(dir_event(d, &d->toDup, p->dup))
+    {
+        dir_push(d, at, c);
+    }
+    if(dir_event(d, &d->toGarbage, p->garbage))
+    {
+        dir_push(d, at, (uint8_t)rng_next(&d->rng));
+    }
+}
+
+void linksim_flush(void *param)
+{
+    /* every byte is on the line as soon as it is put */
+}
+
+uint32_t linksim_getTime(void *param)
+{
+    linksim_end_t *e = (linksim_end_t *)param;
+
+    return (uint32_t)(e->sim->now / 1000000);
+}
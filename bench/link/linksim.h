@@ -0,0 +1,122 @@
+/*
+ * Copyright 2024 Massimiliano Cialdi
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef BENCH_LINK_LINKSIM_H
+#define BENCH_LINK_LINKSIM_H
+
+/*
+ * in process serial link between two ends, in virtual time
+ *
+ * every byte is serialized at the line rate and delivered after a one-way latency;
+ * bits are flipped, bytes dropped, duplicated or garbage inserted with the given
+ * probabilities, from a seeded generator per direction. The two ends run as
+ * coroutines on the calling thread, one at a time: the clock stands still while an
+ * end runs, and moves to the next arrival or timeout when both wait. So a session
+ * takes as long as the link makes it last, whatever the CPU, and runs the same
+ * every time with the same seed.
+ */
+#include <stdint.h>
+#include <stddef.h>
+#include <ucontext.h>
+
+/* link conditions */
+typedef struct linksim_profile
+{
+    const char *name;
+    uint32_t rate; /* bytes/s */
+    uint32_t latencyUs; /* one-way */
+    double ber; /* bit error rate */
+    double drop; /* probability of a byte to be lost */
+    double dup; /* probability of a byte to be delivered twice */
+    double garbage; /* probability of a random byte to be inserted after a byte */
+}linksim_profile_t;
+
+/* one direction of the link: bytes in flight, with their arrival time */
+typedef struct linksim_dir
+{
+    uint64_t *at; /* ns */
+    uint8_t *data;
+    size_t cap; /* a power of two */
+    size_t head;
+    size_t tail;
+    uint64_t txEnd; /* ns, time at which the last byte sent has been serialized */
+    uint64_t rng; /* xorshift64 state */
+    uint64_t toError; /* bits before the next flipped one */
+    uint64_t toDrop; /* bytes before the next one lost */
+    uint64_t toDup; /* bytes before the next one duplicated */
+    uint64_t toGarbage; /* bytes before the next garbage */
+}linksim_dir_t;
+
+typedef struct linksim linksim_t;
+
+/*
+ * an end of the link: the first member of the parameter passed to the ymodem callbacks,
+ * so they can be cast to the callback types
+ */
+typedef struct linksim_end
+{
+    linksim_t *sim;
+    linksim_dir_t *in;
+    linksim_dir_t *out;
+    ucontext_t ctx;
+    void *stack;
+    void (*run)(void *param); /* body of the end, a whole session */
+    void *param;
+    uint64_t wakeAt; /* ns, timeout of the read it is waiting in */
+    int done;
+}linksim_end_t;
+
+struct linksim
+{
+    const linksim_profile_t *profile;
+    uint64_t byteNs; /* serialization time of a byte */
+    uint64_t now; /* ns */
+    linksim_dir_t dir[2]; /* a to b, b to a */
+    linksim_end_t *end[2];
+    ucontext_t main;
+};
+
+/**
+ * @brief set up a link, both directions empty and the clock at 0
+ *
+ * @param sim link
+ * @param profile link conditions
+ * @param seed seed of the error generators
+ * @param a first end, its run and param set (the other fields are set here)
+ * @param b second end, as a
+ * @return 0 on success
+ */
+int linksim_init(linksim_t *sim, const linksim_profile_t *profile, uint64_t seed, linksim_end_t *a, linksim_end_t *b);
+
+/**
+ * @brief run both ends until they return, or the clock reaches limitNs
+ *
+ * @param sim link
+ * @param limitNs virtual time at which the ends are given up
+ * @return 0 if both ends returned
+ */
+int linksim_run(linksim_t *sim, uint64_t limitNs);
+
+/**
+ * @brief free the link
+ */
+void linksim_free(linksim_t *sim);
+
+/* ymodem callbacks, param is the end */
+int linksim_getByte(void *param, uint32_t tout);
+void linksim_putByte(void *param, uint8_t c);
+void linksim_flush(void *param);
+uint32_t linksim_getTime(void *param);
+
+#endif /* BENCH_LINK_LINKSIM_H */
@@ -0,0 +1,138 @@
+/*
+ * Copyright 2024 Massimiliano Cialdi
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef BENCH_PORT_LOOPBACK_H
+#define BENCH_PORT_LOOPBACK_H
+
+/*
+ * in memory loopback: the receiver reads a batch already framed by the benchmark,
+ * no more than chunk bytes per call (1 is like a UART without FIFO), replies are
+ * thrown away and data are stored into a RAM image of the file
+ */
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+#include "crc16-xmodem.h"
+
+typedef struct loopback
+{
+    const uint8_t *stream; /* batch sent to the receiver */
+    size_t streamLen;
+    size_t rdIdx;
+    size_t chunk; /* largest read */
+    size_t replies; /* bytes sent back by the receiver */
+    uint8_t *file; /* RAM image of the received file */
+    size_t fileLen;
+}loopback_t;
+
+static inline int32_t loopback_getBytes(void *param, uint8_t *buf, size_t len, uint32_t tout)
+{
+    loopback_t *lb = (loopback_t *)param;
+    size_t n = lb->streamLen - lb->rdIdx;
+
+    if(n > len)
+    {
+        n = len;
+    }
+    if(n > lb->chunk)
+    {
+        n = lb->chunk;
+    }
+    if(1 == n) /* byte by byte, like reading a data register */
+    {
+        buf[0] = lb->stream[lb->rdIdx];
+    }
+    else
+    {
+        memcpy(buf, &lb->stream[lb->rdIdx], n);
+    }
+    lb->rdIdx += n;
+    return n;
+}
+
+static inline void loopback_putBytes(void *param, const uint8_t *buf, size_t len)
+{
+    loopback_t *lb = (loopback_t *)param;
+
+    lb->replies += len;
+}
+
+static inline void loopback_flush(void *param)
+{
+}
+
+static inline int32_t loopback_processData(void *param, const uint8_t *buffer, size_t buffSz)
+{
+    loopback_t *lb = (loopback_t *)param;
+
+    memcpy(&lb->file[lb->fileLen], buffer, buffSz);
+    lb->fileLen += buffSz;
+    return 0;
+}
+
+/* size of the batch framed by loopback_frame_batch() */
+#define LOOPBACK_BATCH_SIZE(fileSize) (((fileSize) / 1024) * (1024 + 5) + 2 * (128 + 5) + 1)
+
+/* append a block to the stream, return its new length */
+static inline size_t loopback_frame(uint8_t *stream, size_t len, uint8_t start, uint8_t blkNum, const uint8_t *data, size_t dataLen)
+{
+    crc16_xmodem_t crc;
+
+    stream[len++] = start;
+    stream[len++] = blkNum;
+    stream[len++] = ~blkNum;
+    memcpy(&stream[len], data, dataLen);
+    crc = crc16_xmodem_init();
+    crc = crc16_xmodem_update(crc, data, dataLen);
+    crc = crc16_xmodem_finalize(crc);
+    len += dataLen;
+    stream[len++] = crc >> 8;
+    stream[len++] = crc & 0xFF;
+    return len;
+}
+
+/* frame a batch of one file (fileSize multiple of 1024) as a YMODEM sender does, return its length */
+static inline size_t loopback_frame_batch(uint8_t *stream, const uint8_t *file, size_t fileSize)
+{
+    uint8_t blk0[128] = {0};
+    size_t len = 0;
+
+    snprintf((char *)blk0, sizeof(blk0), "bench.bin%c%zu", 0, fileSize);
+    len = loopback_frame(stream, len, 0x01, 0, blk0, sizeof(blk0));
+    for(size_t ofs=0;ofs<fileSize;ofs+=1024)
+    {
+        len = loopback_frame(stream, len, 0x02, 1 + ofs / 1024, &file[ofs], 1024);
+    }
+    stream[len++] = 0x04; /* EOT */
+    memset(blk0, 0, sizeof(blk0)); /* end of batch */
+    len = loopback_frame(stream, len, 0x01, 0, blk0, sizeof(blk0));
+    return len;
+}
+
+/* data the same run after run (xorshift) */
+static inline void loopback_fill(uint8_t *file, size_t fileSize)
+{
+    uint64_t x = 88172645463325252ULL;
+
+    for(size_t i=0;i<fileSize;i++)
+    {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        file[i] = x;
+    }
+}
+
+#endif /* BENCH_PORT_LOOPBACK_H */
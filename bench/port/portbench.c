@@ -0,0 +1,157 @@
+/*
+ * Copyright 2024 Massimiliano Cialdi
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * portbench: cost of the transport and storage callbacks
+ *
+ * usage: portbench-<variant> <variant name>
+ *
+ * a whole batch (one file) is framed in memory, then received again and again
+ * through the loopback transport, reading no more than chunk bytes per call.
+ * Built once with the callbacks called through the pointers of the handle and
+ * once with YM_PORT_BOUND, where the same loopback functions are inlined.
+ * Prints one CSV line (without header) per chunk size:
+ *   variant,chunk,bytes,ns_per_byte
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "ymodem.h"
+#include "loopback.h"
+
+#define FILE_SIZE (1024*1024)
+
+/* minimum time spent on each measure */
+#define MIN_NS (100000000ULL)
+
+/* measures taken, the fastest one is reported (the others have been disturbed) */
+#define MEASURES (5)
+
+static uint8_t stream[LOOPBACK_BATCH_SIZE(FILE_SIZE)];
+static uint8_t file[FILE_SIZE];
+static uint8_t received[FILE_SIZE];
+
+static staticYmodem_t staticYmBuff;
+static loopback_t lb;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static size_t usr_maxFileSize(void *param)
+{
+    return FILE_SIZE;
+}
+
+static int32_t usr_ReceiveStart(void *param, const char *filename)
+{
+    lb.fileLen = 0;
+    return 0;
+}
+
+static int32_t usr_ReceiveEnd(void *param)
+{
+    return 0;
+}
+
+/* receive the whole batch once */
+static int receive(ymodem_desc_t *ymHdl)
+{
+    lb.rdIdx = 0;
+    lb.replies = 0;
+    return ymodem_receive(ymHdl);
+}
+
+static int bench(ymodem_desc_t *ymHdl, const char *variant, size_t chunk)
+{
+    uint64_t iterations = 1;
+    uint64_t ns;
+
+    lb.chunk = chunk;
+    if((0 != receive(ymHdl)) || (FILE_SIZE != lb.fileLen) || (0 != memcmp(file, received, FILE_SIZE)))
+    {
+        fprintf(stderr, "%s: batch not received\n", variant);
+        return -1;
+    }
+
+    /* double the iterations until the measure is long enough */
+    while(1)
+    {
+        uint64_t t0 = now_ns();
+        for(uint64_t i=0;i<iterations;i++)
+        {
+            receive(ymHdl);
+        }
+        ns = now_ns() - t0;
+        if(ns >= MIN_NS)
+        {
+            break;
+        }
+        iterations *= 2;
+    }
+    for(int m=1;m<MEASURES;m++)
+    {
+        uint64_t t0 = now_ns();
+        for(uint64_t i=0;i<iterations;i++)
+        {
+            receive(ymHdl);
+        }
+        uint64_t t = now_ns() - t0;
+        if(t < ns)
+        {
+            ns = t;
+        }
+    }
+    printf("%s,%zu,%d,%.3f\n", variant, chunk, FILE_SIZE, (double)ns / (iterations * FILE_SIZE));
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    static const size_t chunks[] = {1, 16, 1029};
+    const char *variant = argc > 1 ? argv[1] : "-";
+    ymodem_desc_t *ymHdl;
+
+    loopback_fill(file, FILE_SIZE);
+    lb.stream = stream;
+    lb.streamLen = loopback_frame_batch(stream, file, FILE_SIZE);
+    lb.file = received;
+
+    ymHdl = ymodem_init(&staticYmBuff, &lb,
+            usr_maxFileSize,
+            usr_ReceiveStart,
+            loopback_processData,
+            usr_ReceiveEnd,
+            NULL,
+            loopback_getBytes,
+            NULL,
+            loopback_putBytes,
+            loopback_flush);
+
+    for(size_t i=0;i<sizeof(chunks)/sizeof(chunks[0]);i++)
+    {
+        if(0 != bench(ymHdl, variant, chunks[i]))
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,101 @@
+#
+# Copyright 2024 Massimiliano Cialdi
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# helpers shared by the transfer benchmarks, sourced by the bench scripts
+#
+#   bench_init NAME          $TMP, a temporary directory removed on exit with the jobs left
+#   bench_payload KIB [TEXT] $TMP/payload: TEXT repeated, the same run after run, or random bytes
+#   bench_link ARGS...       ptydelay ARGS from $TMP/ttyS (sender) to $TMP/ttyR (receiver), empty $TMP/out
+#   bench_rx CMD             CMD run in $TMP/out on $TMP/ttyR, in the background
+#   bench_tx CMD             CMD payload run on $TMP/ttyS, then waits for the receiver: sets START and END
+#   bench_unlink             stops the ptydelay link
+#   bench_received           true when $TMP/out/payload is the payload
+#   bench_wait_file FILE     waits for FILE to show up (a pty link)
+#   bench_now                prints the time, in seconds
+#   bench_secs START END     prints the seconds in between
+#   bench_kibps BYTES SECS   prints the KiB/s
+
+BENCH_DIR=$(cd "$(dirname "$0")/.." && pwd)
+PTYDELAY=$BENCH_DIR/ptydelay/ptydelay
+RY=$BENCH_DIR/ry/ry
+SY=$BENCH_DIR/sy/sy
+
+bench_init()
+{
+    TMP=$(mktemp -d "/tmp/$1.XXXXXX")
+    trap 'kill $(jobs -p) 2>/dev/null; rm -rf "$TMP"' EXIT
+}
+
+bench_payload()
+{
+    if [ -n "$2" ]; then
+        yes "$2" | head -c $(($1 * 1024)) > "$TMP/payload"
+    else
+        head -c $(($1 * 1024)) /dev/urandom > "$TMP/payload"
+    fi
+}
+
+bench_wait_file()
+{
+    while [ ! -e "$1" ]; do sleep 0.01; done
+}
+
+bench_link()
+{
+    rm -rf "$TMP/out" "$TMP/ttyS" "$TMP/ttyR"
+    mkdir "$TMP/out"
+    "$PTYDELAY" "$@" "$TMP/ttyS" "$TMP/ttyR" &
+    linkPid=$!
+    bench_wait_file "$TMP/ttyR"
+}
+
+bench_rx()
+{
+    (cd "$TMP/out" && $1 <"$TMP/ttyR" >"$TMP/ttyR" 2>/dev/null) &
+    rxPid=$!
+}
+
+bench_tx()
+{
+    START=$(bench_now)
+    (cd "$TMP" && $1 payload <"$TMP/ttyS" >"$TMP/ttyS" 2>/dev/null)
+    wait $rxPid
+    END=$(bench_now)
+}
+
+bench_unlink()
+{
+    kill $linkPid
+    wait $linkPid 2>/dev/null
+}
+
+bench_received()
+{
+    cmp -s "$TMP/payload" "$TMP/out/payload"
+}
+
+bench_now()
+{
+    date +%s.%N
+}
+
+bench_secs()
+{
+    echo "$1 $2" | awk '{ printf "%.3f", $2 - $1 }'
+}
+
+bench_kibps()
+{
+    echo "$1 $2" | awk '{ printf "%.1f", $1 / 1024 / $2 }'
+}
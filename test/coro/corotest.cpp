@@ -0,0 +1,486 @@
+/*
+ * Copyright 2024 Massimiliano Cialdi
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * corotest: many coroutine receivers sharing a few threads
+ *
+ * usage: corotest [-n sessions] [-j threads] [-k size_kib] [-g] [-e bytes] [sender]
+ *
+ * every session has its own pty: the sender (default ../sy/sy) runs on the slave side
+ * and pushes its own file, ymodem::AsyncReceiver receives on the master side. Sessions
+ * are spread round robin over the threads, each running an epoll loop that resumes the
+ * receivers when bytes arrive or their timeout expires. At the end received files are
+ * compared with the sent ones.
+ * With -e the ports report a read error after that many bytes: every session has to be
+ * cancelled, with its file closed, instead of completing.
+ */
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <signal.h>
+#include <termios.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/wait.h>
+#include "ymodem_co.hpp"
+
+/* max file size accepted */
+#define MAX_FILE_SIZE (64*1024*1024)
+
+#define MAX_EVENTS (64)
+
+static std::uint64_t now_ms()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (std::uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* master side of a pty, resumed by the loop of its thread */
+class PtyPort
+{
+public:
+    struct ReadAwaiter
+    {
+        PtyPort &port;
+        std::uint8_t *buf;
+        std::size_t len;
+        std::uint32_t tout;
+        ssize_t n;
+
+        /* bytes already there (or an error): no need to suspend */
+        bool await_ready()
+        {
+            n = port.read(buf, len);
+            return (0 != n) || (0 == tout);
+        }
+
+        void await_suspend(std::coroutine_handle<> h)
+        {
+            port.waiter = h;
+            port.deadline = now_ms() + tout;
+        }
+
+        /* resumed because of bytes or of the timeout */
+        std::int32_t await_resume()
+        {
+            if(0 == n)
+            {
+                n = port.read(buf, len);
+            }
+            return n;
+        }
+    };
+
+    ReadAwaiter read_some(std::uint8_t *buf, std::size_t len, std::uint32_t toutMs)
+    {
+        return ReadAwaiter{*this, buf, len, toutMs, 0};
+    }
+
+    /* bytes stored into buf, 0 if none is there yet, -1 on error */
+    ssize_t read(std::uint8_t *buf, std::size_t len)
+    {
+        if(received >= failAfter) /* error injected with -e */
+        {
+            return -1;
+        }
+        ssize_t n = ::read(fd, buf, len);
+        if(n < 0)
+        {
+            return ((EAGAIN == errno) || (EINTR == errno)) ? 0 : -1;
+        }
+        received += n;
+        return n;
+    }
+
+    void write(const std::uint8_t *buf, std::size_t len)
+    {
+        out.insert(out.end(), buf, buf + len);
+    }
+
+    void flush()
+    {
+        std::size_t sent = 0;
+
+        while(sent < out.size())
+        {
+            ssize_t n = ::write(fd, &out[sent], out.size() - sent);
+            if(n < 0)
+            {
+                if((EAGAIN == errno) || (EINTR == errno))
+                {
+                    struct pollfd pfd = { .fd = fd, .events = POLLOUT, .revents = 0 };
+                    poll(&pfd, 1, 100); /* control sequences are short, the tty will drain soon */
+                    continue;
+                }
+                break;
+            }
+            sent += n;
+        }
+        out.clear();
+    }
+
+    /* resume the receiver waiting on the port, if any */
+    void resume()
+    {
+        std::coroutine_handle<> h = std::exchange(waiter, {});
+        if(h)
+        {
+            h.resume();
+        }
+    }
+
+    int fd = -1;
+    std::coroutine_handle<> waiter;
+    std::uint64_t deadline = 0;
+    std::vector<std::uint8_t> out;
+    std::size_t received = 0;
+    std::size_t failAfter = SIZE_MAX;
+};
+
+/* files are received in memory */
+class MemSink
+{
+public:
+    std::size_t maxFileSize()
+    {
+        return MAX_FILE_SIZE;
+    }
+
+    bool open(const char *filename)
+    {
+        name = filename;
+        data.clear();
+        return true;
+    }
+
+    bool write(const std::uint8_t *buf, std::size_t len)
+    {
+        data.insert(data.end(), buf, buf + len);
+        return true;
+    }
+
+    void close()
+    {
+        files++;
+    }
+
+    std::string name;
+    std::vector<std::uint8_t> data;
+    unsigned files = 0;
+};
+
+struct Session
+{
+    PtyPort port;
+    MemSink sink;
+    ymodem::AsyncReceiver<> rx;
+    std::optional<ymodem::Task<bool>> task;
+    std::string name; /* file sent */
+    std::vector<std::uint8_t> payload;
+    int slaveFd = -1;
+    pid_t pid = -1;
+    bool retired = false; /* over and out of the loop */
+};
+
+static ymodem::Task<bool> session_run(Session &s)
+{
+    bool ok = co_await s.rx.receive_all(s.port, s.sink);
+    co_return ok;
+}
+
+/* one thread: starts its sessions and resumes them until all are over */
+static void loop_run(std::vector<Session *> sessions)
+{
+    int epFd = epoll_create1(0);
+    struct epoll_event events[MAX_EVENTS];
+    std::size_t active = sessions.size();
+
+    for(Session *s : sessions)
+    {
+        struct epoll_event ev = {};
+        ev.events = EPOLLIN;
+        ev.data.ptr = s;
+        epoll_ctl(epFd, EPOLL_CTL_ADD, s->port.fd, &ev);
+        s->task.emplace(session_run(*s));
+        s->task->start();
+    }
+
+    while(active > 0)
+    {
+        /* sleep until the nearest timeout */
+        std::uint64_t now = now_ms();
+        std::uint64_t tout = UINT32_MAX;
+        for(Session *s : sessions)
+        {
+            if(s->port.waiter)
+            {
+                std::uint64_t t = (s->port.deadline > now) ? s->port.deadline - now : 0;
+                tout = (t < tout) ? t : tout;
+            }
+        }
+
+        int n = epoll_wait(epFd, events, MAX_EVENTS, (int)tout);
+        for(int e=0;e<n;e++)
+        {
+            static_cast<Session *>(events[e].data.ptr)->port.resume();
+        }
+
+        /* handle timeouts, retire the sessions which are over */
+        now = now_ms();
+        active = 0;
+        for(Session *s : sessions)
+        {
+            if(s->port.waiter && (s->port.deadline <= now))
+            {
+                s->port.resume();
+            }
+            if(!s->task->done())
+            {
+                active++;
+            }
+            else if(!s->retired)
+            {
+                /* the master stays open until the sender has read the last ACK */
+                epoll_ctl(epFd, EPOLL_CTL_DEL, s->port.fd, nullptr);
+                s->retired = true;
+            }
+        }
+    }
+    ::close(epFd);
+}
+
+/* pty pair: non-blocking master for the receiver, raw slave for the sender */
+static int session_open(Session &s)
+{
+    s.port.fd = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if((s.port.fd < 0) || (0 != grantpt(s.port.fd)) || (0 != unlockpt(s.port.fd)))
+    {
+        perror("posix_openpt()");
+        return -1;
+    }
+    const char *name = ptsname(s.port.fd);
+
+    /* the slave is kept open, so the master doesn't see a hang up when the sender exits */
+    s.slaveFd = open(name, O_RDWR | O_NOCTTY | O_CLOEXEC);
+    struct termios tio;
+    if((s.slaveFd < 0) || (0 != tcgetattr(s.slaveFd, &tio)))
+    {
+        perror(name);
+        return -1;
+    }
+    cfmakeraw(&tio);
+    tcsetattr(s.slaveFd, TCSANOW, &tio);
+    fcntl(s.port.fd, F_SETFL, O_NONBLOCK);
+    return 0;
+}
+
+static pid_t sender_spawn(Session &s, const char *sender, const char *dir)
+{
+    pid_t pid = fork();
+    if(0 == pid)
+    {
+        int devNull = open("/dev/null", O_WRONLY);
+        dup2(s.slaveFd, 0);
+        dup2(s.slaveFd, 1);
+        dup2(devNull, 2);
+        if(0 != chdir(dir))
+        {
+            _exit(127);
+        }
+        execl(sender, sender, s.name.c_str(), (char *)nullptr);
+        _exit(127);
+    }
+    return pid;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [-n sessions] [-j threads] [-k size_kib] [-g] [-e bytes] [sender]\n"
+            "  -n sessions  concurrent transfers (default 64)\n"
+            "  -j threads   threads sharing them (default 2)\n"
+            "  -k size_kib  size of the first file, the others grow by 1 KiB + 37 bytes (default 64)\n"
+            "  -g           YMODEM-g\n"
+            "  -e bytes     ports fail after receiving bytes, sessions have to be cancelled\n"
+            "  sender       sender command, file name is appended (default ../sy/sy)\n",
+            prog);
+}
+
+int main(int argc, char *argv[])
+{
+    std::size_t nSessions = 64;
+    std::size_t nThreads = 2;
+    std::size_t sizeKib = 64;
+    ymodem_mode_t mode = ymMode_crc;
+    std::size_t failAfter = SIZE_MAX;
+    const char *sender = "../sy/sy";
+    int opt;
+
+    while(-1 != (opt = getopt(argc, argv, "n:j:k:ge:h")))
+    {
+        switch(opt)
+        {
+        case 'n':
+            nSessions = strtoul(optarg, NULL, 0);
+            break;
+        case 'j':
+            nThreads = strtoul(optarg, NULL, 0);
+            break;
+        case 'k':
+            sizeKib = strtoul(optarg, NULL, 0);
+            break;
+        case 'g':
+            mode = ymMode_g;
+            break;
+        case 'e':
+            failAfter = strtoul(optarg, NULL, 0);
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if(optind < argc)
+    {
+        sender = argv[optind];
+    }
+    if((0 == nSessions) || (0 == nThreads))
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    char senderPath[PATH_MAX];
+    if(NULL == realpath(sender, senderPath))
+    {
+        perror(sender);
+        return 1;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    char dir[] = "/tmp/corotest.XXXXXX";
+    if(NULL == mkdtemp(dir))
+    {
+        perror("mkdtemp()");
+        return 1;
+    }
+
+    /* one file per session, all of different sizes and contents */
+    std::vector<std::unique_ptr<Session>> sessions;
+    std::uint32_t seed = 1;
+    for(std::size_t i=0;i<nSessions;i++)
+    {
+        auto s = std::make_unique<Session>();
+        s->name = "file" + std::to_string(i);
+        s->payload.resize(sizeKib * 1024 + i * 1061);
+        for(std::uint8_t &b : s->payload)
+        {
+            seed = seed * 1103515245 + 12345;
+            b = seed >> 16;
+        }
+        std::string path = std::string(dir) + "/" + s->name;
+        FILE *f = fopen(path.c_str(), "wb");
+        if((NULL == f) || (s->payload.size() != fwrite(s->payload.data(), 1, s->payload.size(), f)))
+        {
+            perror(path.c_str());
+            return 1;
+        }
+        fclose(f);
+        if(0 != session_open(*s))
+        {
+            return 1;
+        }
+        s->rx.setMode(mode);
+        s->port.failAfter = failAfter;
+        sessions.push_back(std::move(s));
+    }
+
+    std::uint64_t startMs = now_ms();
+    for(auto &s : sessions)
+    {
+        s->pid = sender_spawn(*s, senderPath, dir);
+    }
+
+    /* sessions are spread round robin over the threads */
+    std::vector<std::thread> threads;
+    for(std::size_t t=0;t<nThreads;t++)
+    {
+        std::vector<Session *> mine;
+        for(std::size_t i=t;i<nSessions;i+=nThreads)
+        {
+            mine.push_back(sessions[i].get());
+        }
+        threads.emplace_back(loop_run, std::move(mine));
+    }
+    for(std::thread &t : threads)
+    {
+        t.join();
+    }
+    std::uint64_t elapsedMs = now_ms() - startMs;
+
+    /* summary */
+    std::uint64_t totBytes = 0;
+    std::size_t failed = 0;
+    for(auto &s : sessions)
+    {
+        int wstatus = 0;
+        if(SIZE_MAX != failAfter) /* nobody drains the pty any more, hang up the sender */
+        {
+            ::close(s->port.fd);
+        }
+        waitpid(s->pid, &wstatus, 0);
+        ::close(s->slaveFd);
+        if(SIZE_MAX == failAfter)
+        {
+            ::close(s->port.fd);
+        }
+        unlink((std::string(dir) + "/" + s->name).c_str());
+        bool ok;
+        if(SIZE_MAX == failAfter)
+        {
+            ok = s->task->result() && (1 == s->sink.files) && (s->name == s->sink.name) &&
+                 (s->payload == s->sink.data) && WIFEXITED(wstatus) && (0 == WEXITSTATUS(wstatus));
+        }
+        else /* cancelled: the file has been closed, the sender could not finish */
+        {
+            ok = !s->task->result() && (1 == s->sink.files) && (s->sink.data.size() < s->payload.size()) &&
+                 WIFEXITED(wstatus) && (0 != WEXITSTATUS(wstatus));
+        }
+        if(!ok)
+        {
+            fprintf(stderr, "%s: receiver %d, sender status %d, %u files, %zu/%zu bytes\n", s->name.c_str(),
+                    (int)s->task->result(), wstatus, s->sink.files, s->sink.data.size(), s->payload.size());
+            failed++;
+        }
+        totBytes += s->sink.data.size();
+    }
+    rmdir(dir);
+    fprintf(stderr, "total: %zu sessions on %zu threads, %zu failed, %llu bytes, %llu ms, %.1f KiB/s\n",
+            nSessions, nThreads, failed, (unsigned long long)totBytes, (unsigned long long)elapsedMs,
+            elapsedMs ? (totBytes / 1024.0) / (elapsedMs / 1000.0) : 0.0);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,103 @@
+/*
+ * Copyright 2024 Massimiliano Cialdi
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * crccheck: cross-check a crc backend against the bit-by-bit one
+ *
+ * The backend under test is linked as is, the bit-by-bit reference is
+ * compiled with its functions renamed to ref_*.
+ * Every length from 0 to 64 KiB is checked, the message being split in two
+ * update calls at a random point. Then misaligned buffers are checked.
+ * Every check is done with both crc16_xmodem_update() and
+ * crc16_xmodem_copy_update(), the copy being verified too.
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "crc16-xmodem.h"
+
+#define MAX_LEN (64*1024)
+
+/* reference implementation (bit-by-bit), initial value is 0 */
+crc16_xmodem_t ref_crc16_xmodem_update(crc16_xmodem_t crc, const void *data, size_t data_len);
+crc16_xmodem_t ref_crc16_xmodem_finalize(crc16_xmodem_t crc);
+
+static uint8_t buf[MAX_LEN + 16];
+static uint8_t copy[MAX_LEN + 16];
+
+static crc16_xmodem_t crc_split(const uint8_t *data, size_t len, size_t split)
+{
+    crc16_xmodem_t crc = crc16_xmodem_init();
+    crc = crc16_xmodem_update(crc, data, split);
+    crc = crc16_xmodem_update(crc, data + split, len - split);
+    return crc16_xmodem_finalize(crc);
+}
+
+/* same as crc_split() with crc16_xmodem_copy_update(), return crc ^ 0xffff if the copy is wrong */
+static crc16_xmodem_t crc_copy_split(const uint8_t *data, size_t len, size_t split)
+{
+    crc16_xmodem_t crc = crc16_xmodem_init();
+    memset(copy, 0, len);
+    crc = crc16_xmodem_copy_update(crc, copy, data, split);
+    crc = crc16_xmodem_copy_update(crc, copy + split, data + split, len - split);
+    crc = crc16_xmodem_finalize(crc);
+    return memcmp(copy, data, len) ? crc ^ 0xffff : crc;
+}
+
+int main(void)
+{
+    unsigned errors = 0;
+
+    srand(1);
+    for (size_t i = 0; i < sizeof(buf); i++) {
+        buf[i] = (uint8_t)rand();
+    }
+
+    /* every length, the reference state is advanced one byte at a time */
+    crc16_xmodem_t ref = 0;
+    for (size_t len = 0; len <= MAX_LEN; len++) {
+        if (len > 0) {
+            ref = ref_crc16_xmodem_update(ref, &buf[len - 1], 1);
+        }
+        size_t split = (len > 0) ? (size_t)rand() % (len + 1) : 0;
+        crc16_xmodem_t expected = ref_crc16_xmodem_finalize(ref);
+        crc16_xmodem_t crc = crc_split(buf, len, split);
+        crc16_xmodem_t crcCopy = crc_copy_split(buf, len, split);
+        if ((crc != expected) || (crcCopy != expected)) {
+            if (errors++ < 10) {
+                printf("len %zu split %zu: 0x%04x/0x%04x, expected 0x%04x\n", len, split, crc, crcCopy, expected);
+            }
+        }
+    }
+
+    /* misaligned buffers */
+    for (size_t offset = 1; offset < 16; offset++) {
+        for (int n = 0; n < 64; n++) {
+            size_t len = (size_t)rand() % (MAX_LEN - 16);
+            crc16_xmodem_t expected = ref_crc16_xmodem_finalize(ref_crc16_xmodem_update(0, &buf[offset], len));
+            crc16_xmodem_t crc = crc_split(&buf[offset], len, len / 2);
+            crc16_xmodem_t crcCopy = crc_copy_split(&buf[offset], len, len / 2);
+            if ((crc != expected) || (crcCopy != expected)) {
+                if (errors++ < 10) {
+                    printf("offset %zu len %zu: 0x%04x/0x%04x, expected 0x%04x\n", offset, len, crc, crcCopy, expected);
+                }
+            }
+        }
+    }
+
+    printf("%s: %u errors\n", errors ? "FAIL" : "PASS", errors);
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,31 @@
+/*
+ * Copyright 2024 Massimiliano Cialdi
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * footprint: size of the receiver and sender handles
+ *
+ * the makefile compiles it once per configuration profile and reads the sizes
+ * of these instances from the symbol table, so it works with cross compilers too.
+ * It also checks the budget of the minimal RAM profile
+ */
+#include "ymodem.h"
+
+staticYmodem_t footprintRx;
+staticYmodemTx_t footprintTx;
+
+#if YM_RX_MIN_RAM
+/* the minimal RAM profile is for bootloaders: its receiver has to stay under 256 bytes on 32-bit targets */
+_Static_assert((sizeof(void *) != 4) || (sizeof(staticYmodem_t) < 256), "minimal RAM receiver handle over budget");
+#endif
@@ -0,0 +1,72 @@
+/*
+ * Copyright 2024 Massimiliano Cialdi
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TEST_FOOTPRINT_YMODEM_PORT_H
+#define TEST_FOOTPRINT_YMODEM_PORT_H
+
+#include <stdint.h>
+#include <stddef.h>    /* for size_t */
+#include <sys/types.h> /* for ssize_t */
+#include <string.h>
+#include <stdlib.h>
+
+
+/**
+ * @brief log function
+ *
+ * logging is disabled, it is not needed to measure sizes
+ */
+#define ymodem_log(...)
+
+
+/**
+ * @brief implementation of stpncpy
+ *
+ * library function is used
+ */
+static inline char *ymodem_port_stpncpy(char *dst, const char *src, size_t sz)
+{
+    return stpncpy(dst, src, sz);
+}
+
+/**
+ * @brief implementation of memchr
+ *
+ * library function is used
+ */
+static inline void *ymodem_port_memchr(const void *s, int c, size_t n)
+{
+    return memchr(s, c, n);
+}
+
+/**
+ * @brief implementation of atoi
+ *
+ * library function is used
+ */
+static inline int ymodem_port_atoi(const char *nptr)
+{
+    return atoi(nptr);
+}
+
+/**
+ * @brief free running counter timing the receiver phases (YM_RX_PROFILE) and trace records (YM_TRACE_LEVEL)
+ *
+ * only declared, nothing is linked
+ */
+uint32_t ymodem_port_ticks(void);
+
+
+#endif /* TEST_FOOTPRINT_YMODEM_PORT_H */
@@ -0,0 +1,55 @@
+#!/bin/sh
+#
+# Copyright 2024 Massimiliano Cialdi
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# YMODEM versus YMODEM-g throughput over a latency-injected pty pair
+#
+# for every one-way delay a file is sent to ry, once in YMODEM mode ('C')
+# and once in YMODEM-g mode ('G'). Output is CSV on stdout.
+#
+# environment:
+#   DELAYS   one-way delays in ms (default "0 1 5 10 20")
+#   SIZE_KIB size of the file sent (default 256)
+#   RATE     line rate in bytes/s, 0 = unlimited (default 0)
+#   SENDER   sender command, file name is appended (default test/sy/sy)
+
+. "$(dirname "$0")/../benchlib.sh"
+
+DELAYS=${DELAYS:-"0 1 5 10 20"}
+SIZE_KIB=${SIZE_KIB:-256}
+RATE=${RATE:-0}
+SENDER=${SENDER:-$SY}
+
+bench_init ymodem-g-bench
+bench_payload "$SIZE_KIB"
+
+echo "mode,delay_ms,rate,bytes,seconds,KiBps"
+for delay in $DELAYS; do
+    for mode in C G; do
+        bench_link -d "$delay" -r "$RATE"
+        opt=""
+        [ "$mode" = "G" ] && opt="-g"
+        bench_rx "$RY $opt"
+        bench_tx "$SENDER"
+        bench_unlink
+
+        if ! bench_received; then
+            echo "$mode,$delay,$RATE,transfer failed" >&2
+            continue
+        fi
+        bytes=$((SIZE_KIB * 1024))
+        secs=$(bench_secs "$START" "$END")
+        echo "$mode,$delay,$RATE,$bytes,$secs,$(bench_kibps "$bytes" "$secs")"
+    done
+done
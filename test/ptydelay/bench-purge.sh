@@ -0,0 +1,73 @@
+#!/bin/sh
+#
+# Copyright 2024 Massimiliano Cialdi
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# stop and wait transfer over a noisy link: goodput versus bit error rate
+#
+# for every bit error rate and seed, the same file is sent by sy to ry over a
+# ptydelay link, in 1K blocks and stop and wait: once with the line purged after a
+# broken block ("purge") and once NAKing it at once ("nopurge", ry -p 0). With
+# BEFORE set, ry and sy found there are run too ("before"): build them from an
+# older tree with YM_MAX_BLOCK_SIZE=1024. Goodput counts failed sessions as zero
+# bytes, over all the seeds. Output is CSV on stdout, one line per variant and rate.
+#
+# environment:
+#   BERS     bit error rates (default "0 5e-6 1e-5 2e-5 4e-5")
+#   SEEDS    seeds of the error generator, a transfer each (default "1 2 3 4")
+#   DELAY    one-way delay in ms (default 5)
+#   RATE     line rate in bytes/s, 0 = unlimited (default 0)
+#   SIZE_KIB size of the file sent (default 1024)
+#   BEFORE   directory holding ry and sy to compare with (default none)
+
+. "$(dirname "$0")/../benchlib.sh"
+
+BERS=${BERS:-"0 5e-6 1e-5 2e-5 4e-5"}
+SEEDS=${SEEDS:-"1 2 3 4"}
+DELAY=${DELAY:-5}
+RATE=${RATE:-0}
+SIZE_KIB=${SIZE_KIB:-1024}
+
+VARIANTS="purge nopurge"
+if [ -n "$BEFORE" ]; then
+    VARIANTS="$VARIANTS before"
+fi
+
+bench_init ymodem-purge-bench
+bench_payload "$SIZE_KIB" "YAYModem stop and wait transfer over a noisy link"
+
+echo "variant,ber,delay_ms,rate,bytes,runs,failed,seconds,goodput_KiBps"
+for ber in $BERS; do
+    for variant in $VARIANTS; do
+        case $variant in
+        purge) ry="$RY -w 1 -b 1024"; sy=$SY ;;
+        nopurge) ry="$RY -w 1 -b 1024 -p 0"; sy=$SY ;;
+        before) ry="$BEFORE/ry -w 1"; sy=$BEFORE/sy ;;
+        esac
+        runs=0
+        failed=0
+        total=0
+        for seed in $SEEDS; do
+            bench_link -d "$DELAY" -r "$RATE" -b "$ber" -s "$seed"
+            bench_rx "$ry"
+            bench_tx "$sy"
+            bench_unlink
+
+            runs=$((runs + 1))
+            bench_received || failed=$((failed + 1))
+            total=$(echo "$total $(bench_secs "$START" "$END")" | awk '{ printf "%.3f", $1 + $2 }')
+        done
+        bytes=$((SIZE_KIB * 1024))
+        echo "$variant,$ber,$DELAY,$RATE,$bytes,$runs,$failed,$total,$(bench_kibps $(((runs - failed) * bytes)) "$total")"
+    done
+done
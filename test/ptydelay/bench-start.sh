@@ -0,0 +1,68 @@
+#!/bin/sh
+#
+# Copyright 2024 Massimiliano Cialdi
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# session start: time to first block versus 'C' polling interval
+#
+# ry is started first, sy after a random offset. Until then the requests of ry
+# are lost (ptydelay -l), as on a line nobody listens to. A one block file is
+# sent, so the time from the start of sy to the end of the session is the time
+# to the first block plus a few round trips. Offsets come from a seeded
+# generator, every polling interval sees the same ones. Output is CSV on stdout.
+#
+# environment:
+#   POLLS         polling intervals in ms, 0 = every 10 s (default "0 250 1000")
+#   RUNS          transfers per interval (default 10)
+#   MAX_OFFSET_MS largest start offset of the sender (default 5000)
+#   DELAY         one-way delay in ms (default 5)
+#   SEED          seed of the offsets (default 1)
+
+. "$(dirname "$0")/../benchlib.sh"
+
+POLLS=${POLLS:-"0 250 1000"}
+RUNS=${RUNS:-10}
+MAX_OFFSET_MS=${MAX_OFFSET_MS:-5000}
+DELAY=${DELAY:-5}
+SEED=${SEED:-1}
+
+bench_init ymodem-start-bench
+yes "YAYModem session start" | head -c 1000 > "$TMP/payload"
+OFFSETS=$(awk -v n="$RUNS" -v max="$MAX_OFFSET_MS" -v seed="$SEED" \
+    'BEGIN { srand(seed); for (i = 0; i < n; i++) printf "%d ", rand() * max }')
+
+echo "poll_ms,delay_ms,runs,failed,mean_s,max_s"
+for poll in $POLLS; do
+    failed=0
+    times=""
+    for offset in $OFFSETS; do
+        bench_link -d "$DELAY" -l "$offset"
+        bench_rx "$RY -c $poll"
+        sleep "$(echo "$offset" | awk '{ printf "%.3f", $1 / 1000 }')"
+        bench_tx "$SY"
+        bench_unlink
+
+        if bench_received; then
+            times="$times $(bench_secs "$START" "$END")"
+        else
+            failed=$((failed + 1))
+        fi
+    done
+    echo "$poll $DELAY $RUNS $failed $times" | awk '{
+        n = NF - 4; sum = 0; max = 0;
+        for (i = 5; i <= NF; i++) { sum += $i; if ($i > max) max = $i }
+        if (n > 0)
+            printf "%d,%d,%d,%d,%.3f,%.3f\n", $1, $2, $3, $4, sum / n, max
+        else
+            printf "%d,%d,%d,%d,,\n", $1, $2, $3, $4 }'
+done
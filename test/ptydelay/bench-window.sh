@@ -0,0 +1,71 @@
+#!/bin/sh
+#
+# Copyright 2024 Massimiliano Cialdi
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# windowed transfer over a lossy link: throughput versus window and bit error rate
+#
+# for every bit error rate and window, the same file is sent by sy to ry over a
+# ptydelay link. Bit errors are injected at the same positions of the byte stream
+# run after run (seeded), so results are repeatable. Then the same runs lose one
+# ACK of the receiver: with a window the sender gets the ACKs of the following
+# blocks, never the one of its oldest, and has to send it again. ry waits less than
+# sy, so its NAKs arrive while sy is still waiting. Output is CSV on stdout, result
+# is "failed" when the session has been aborted (too many retries).
+#
+# environment:
+#   WINDOWS  windows accepted by ry (default "1 2 4 8")
+#   BERS     bit error rates (default "0 1e-7 1e-6")
+#   DELAY    one-way delay in ms (default 20)
+#   RATE     line rate in bytes/s, 0 = unlimited (default 0)
+#   SIZE_KIB size of the file sent (default 1024)
+#   SEED     seed of the error generator (default 1)
+#   LOST_ACK which ACK byte of the receiver is lost, from 1, 0 = none (default "0 4")
+#   RX_WAIT  ms ry waits for a block before NAKing it, sy waits 10000 (default 3000)
+#   BLOCK    largest block accepted by ry (default 1024: with a 16-bit CRC 32K blocks
+#            hardly get through once bits are flipped)
+
+. "$(dirname "$0")/../benchlib.sh"
+
+WINDOWS=${WINDOWS:-"1 2 4 8"}
+BERS=${BERS:-"0 1e-7 1e-6"}
+DELAY=${DELAY:-20}
+RATE=${RATE:-0}
+SIZE_KIB=${SIZE_KIB:-1024}
+SEED=${SEED:-1}
+LOST_ACK=${LOST_ACK:-"0 4"}
+RX_WAIT=${RX_WAIT:-3000}
+BLOCK=${BLOCK:-1024}
+
+bench_init ymodem-window-bench
+bench_payload "$SIZE_KIB" "YAYModem windowed transfer over a lossy link"
+
+echo "window,ber,lost_ack,block,delay_ms,rate,bytes,seconds,KiBps,result"
+for lost in $LOST_ACK; do
+for ber in $BERS; do
+    for window in $WINDOWS; do
+        bench_link -d "$DELAY" -r "$RATE" -b "$ber" -s "$SEED" -a "$lost"
+        bench_rx "$RY -w $window -b $BLOCK -k $RX_WAIT"
+        bench_tx "$SY"
+        bench_unlink
+
+        bytes=$((SIZE_KIB * 1024))
+        if bench_received; then
+            secs=$(bench_secs "$START" "$END")
+            echo "$window,$ber,$lost,$BLOCK,$DELAY,$RATE,$bytes,$secs,$(bench_kibps "$bytes" "$secs"),ok"
+        else
+            echo "$window,$ber,$lost,$BLOCK,$DELAY,$RATE,$bytes,,,failed"
+        fi
+    done
+done
+done
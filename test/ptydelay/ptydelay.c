@@ -0,0 +1,360 @@
+/*
+ * Copyright 2024 Massimiliano Cialdi
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * ptydelay: pty pair with latency injection
+ *
+ * like `socat pty,raw,echo=0,link=A pty,raw,echo=0,link=B`, but every chunk
+ * of bytes is delivered to the other side after a one-way delay, optionally
+ * limiting the rate as a serial line would do, and flipping bits with a given
+ * bit error rate. Errors come from a seeded generator per direction, so they hit
+ * the same positions of the byte stream run after run. The first side can come up
+ * late: bytes sent to it before are lost, as on a line nobody listens to. One ACK
+ * sent by the second side (the receiver) can be lost too.
+ */
+#define _XOPEN_SOURCE 600
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <poll.h>
+#include <termios.h>
+#include <time.h>
+#include <math.h>
+
+/* bytes read from a side in one go */
+#define CHUNK_SIZE (4096)
+
+#define ACK (0x06)
+
+typedef struct chunk
+{
+    struct chunk *next;
+    uint64_t deliverAt; /* us */
+    size_t len;
+    size_t sent; /* bytes already written */
+    uint8_t data[];
+}chunk_t;
+
+/* one direction of the link */
+typedef struct direction
+{
+    int inFd; /* master we read from */
+    int outFd; /* master we write to */
+    uint64_t txEnd; /* us, time at which the last queued byte has been serialized */
+    uint64_t rng; /* xorshift64 state */
+    uint64_t bitsToError; /* good bits before the next flipped one */
+    uint64_t upAt; /* us, bytes read before are lost */
+    uint64_t acksToLose; /* the n-th ACK byte (0x06) read from now on is lost, 0 = none */
+    chunk_t *head;
+    chunk_t *tail;
+}direction_t;
+
+static volatile sig_atomic_t stopRequested;
+
+static uint64_t delayUs;
+static uint64_t rate; /* bytes/s, 0 = unlimited */
+static double ber; /* bit error rate, 0 = error free */
+
+static uint64_t now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* spread the bits of a small seed, xorshift would start with tiny values */
+static uint64_t rng_seed(uint64_t seed)
+{
+    uint64_t z = seed + 0x9E3779B97F4A7C15ull;
+
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    z ^= z >> 31;
+    return z ? z : 1;
+}
+
+/* uniform in (0, 1] */
+static double rng_uniform(uint64_t *state)
+{
+    uint64_t x = *state;
+
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return ((x >> 11) + 1) * (1.0 / 9007199254740992.0);
+}
+
+/* good bits before the next error: bit errors are independent, so the gap is geometric */
+static uint64_t next_error_gap(uint64_t *state)
+{
+    return (uint64_t)(-log(rng_uniform(state)) / ber);
+}
+
+/* flip the bits of a chunk hit by errors */
+static void direction_corrupt(direction_t *d, uint8_t *data, size_t len)
+{
+    uint64_t bits = (uint64_t)len * 8;
+    uint64_t pos = 0;
+
+    while(d->bitsToError < bits - pos)
+    {
+        pos += d->bitsToError;
+        data[pos / 8] ^= 1 << (pos % 8);
+        pos++;
+        d->bitsToError = next_error_gap(&d->rng);
+    }
+    d->bitsToError -= bits - pos;
+}
+
+/* lose the chosen ACK byte if it is in the chunk, return the new length */
+static size_t direction_lose_ack(direction_t *d, uint8_t *data, size_t len)
+{
+    for(size_t i=0;(i<len) && (d->acksToLose > 0);i++)
+    {
+        if((ACK == data[i]) && (0 == --d->acksToLose))
+        {
+            memmove(&data[i], &data[i + 1], len - i - 1);
+            return len - 1;
+        }
+    }
+    return len;
+}
+
+/* open a pty master, make its slave raw and link it */
+static int pty_open(const char *link, int *slaveFd)
+{
+    int fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if((fd < 0) || (0 != grantpt(fd)) || (0 != unlockpt(fd)))
+    {
+        perror("posix_openpt()");
+        return -1;
+    }
+    const char *name = ptsname(fd);
+
+    /* the slave is kept open, so the master doesn't see a hang up between clients */
+    *slaveFd = open(name, O_RDWR | O_NOCTTY);
+    struct termios tio;
+    if((*slaveFd < 0) || (0 != tcgetattr(*slaveFd, &tio)))
+    {
+        perror(name);
+        return -1;
+    }
+    cfmakeraw(&tio);
+    tcsetattr(*slaveFd, TCSANOW, &tio);
+
+    unlink(link);
+    if(0 != symlink(name, link))
+    {
+        perror(link);
+        return -1;
+    }
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    return fd;
+}
+
+static void direction_read(direction_t *d)
+{
+    uint8_t buf[CHUNK_SIZE];
+    ssize_t n = read(d->inFd, buf, sizeof(buf));
+    if(n <= 0)
+    {
+        return;
+    }
+    uint64_t now = now_us();
+    if(now < d->upAt) /* nobody listens yet */
+    {
+        return;
+    }
+    n = direction_lose_ack(d, buf, n);
+    if(0 == n)
+    {
+        return;
+    }
+
+    chunk_t *c = malloc(sizeof(chunk_t) + n);
+    if(NULL == c)
+    {
+        return;
+    }
+    if(rate > 0) /* bytes leave one after the other */
+    {
+        d->txEnd = (d->txEnd > now ? d->txEnd : now) + (uint64_t)n * 1000000 / rate;
+        c->deliverAt = d->txEnd + delayUs;
+    }
+    else
+    {
+        c->deliverAt = now + delayUs;
+    }
+    c->next = NULL;
+    c->len = n;
+    c->sent = 0;
+    memcpy(c->data, buf, n);
+    if(ber > 0)
+    {
+        direction_corrupt(d, c->data, n);
+    }
+    if(NULL == d->tail)
+    {
+        d->head = c;
+    }
+    else
+    {
+        d->tail->next = c;
+    }
+    d->tail = c;
+}
+
+/* deliver due chunks, return us to wait before the next one, -1 if none */
+static int64_t direction_deliver(direction_t *d)
+{
+    uint64_t now = now_us();
+
+    while(NULL != d->head)
+    {
+        chunk_t *c = d->head;
+        if(c->deliverAt > now)
+        {
+            return c->deliverAt - now;
+        }
+        ssize_t n = write(d->outFd, &c->data[c->sent], c->len - c->sent);
+        if(n < 0)
+        {
+            return (EAGAIN == errno) ? 1000 : -1; /* other side is not reading, retry later */
+        }
+        c->sent += n;
+        if(c->sent < c->len)
+        {
+            return 1000;
+        }
+        d->head = c->next;
+        if(NULL == d->head)
+        {
+            d->tail = NULL;
+        }
+        free(c);
+    }
+    return -1;
+}
+
+static void on_signal(int sig)
+{
+    stopRequested = 1;
+}
+
+int main(int argc, char *argv[])
+{
+    int opt;
+    uint64_t seed = 1;
+    uint64_t lateUs = 0;
+    uint64_t loseAck = 0;
+
+    while(-1 != (opt = getopt(argc, argv, "d:r:b:s:l:a:")))
+    {
+        switch(opt)
+        {
+        case 'd':
+            delayUs = strtoull(optarg, NULL, 0) * 1000;
+            break;
+        case 'r':
+            rate = strtoull(optarg, NULL, 0);
+            break;
+        case 'b':
+            ber = strtod(optarg, NULL);
+            break;
+        case 's':
+            seed = strtoull(optarg, NULL, 0);
+            break;
+        case 'l':
+            lateUs = strtoull(optarg, NULL, 0) * 1000;
+            break;
+        case 'a':
+            loseAck = strtoull(optarg, NULL, 0);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-d delay_ms] [-r bytes_per_s] [-b bit_error_rate] [-s seed] [-l late_ms] [-a nth_ack_lost] linkA linkB\n", argv[0]);
+            return 1;
+        }
+    }
+    if(argc - optind != 2)
+    {
+        fprintf(stderr, "usage: %s [-d delay_ms] [-r bytes_per_s] [-b bit_error_rate] [-s seed] [-l late_ms] [-a nth_ack_lost] linkA linkB\n", argv[0]);
+        return 1;
+    }
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+
+    int slaveA, slaveB;
+    int fdA = pty_open(argv[optind], &slaveA);
+    int fdB = pty_open(argv[optind + 1], &slaveB);
+    if((fdA < 0) || (fdB < 0))
+    {
+        return 1;
+    }
+
+    direction_t dir[2] = {
+        { .inFd = fdA, .outFd = fdB, .rng = rng_seed(seed * 2) },
+        { .inFd = fdB, .outFd = fdA, .rng = rng_seed(seed * 2 + 1), .upAt = now_us() + lateUs, .acksToLose = loseAck },
+    };
+    if(ber > 0)
+    {
+        for(int i=0;i<2;i++)
+        {
+            dir[i].bitsToError = next_error_gap(&dir[i].rng);
+        }
+    }
+
+    while(!stopRequested)
+    {
+        int64_t waitUs = -1;
+        for(int i=0;i<2;i++)
+        {
+            int64_t w = direction_deliver(&dir[i]);
+            if((w >= 0) && ((waitUs < 0) || (w < waitUs)))
+            {
+                waitUs = w;
+            }
+        }
+
+        struct pollfd pfd[2] = {
+            { .fd = fdA, .events = POLLIN },
+            { .fd = fdB, .events = POLLIN },
+        };
+        int tout = (waitUs < 0) ? -1 : (int)((waitUs + 999) / 1000);
+        if(poll(pfd, 2, tout) < 0)
+        {
+            continue; /* EINTR */
+        }
+        for(int i=0;i<2;i++)
+        {
+            if(pfd[i].revents & POLLIN)
+            {
+                direction_read(&dir[i]);
+            }
+        }
+    }
+
+    unlink(argv[optind]);
+    unlink(argv[optind + 1]);
+    return 0;
+}
@@ -16,18 +16,39 @@
 #include <stdint.h>
 #include <fcntl.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <sys/time.h>
+#include <time.h>
 #include <fcntl.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <pthread.h>
 #include "ymodem.h"
+#include "ymodem_trace.h"
 
 /* max file size supported in byte */
 #define MAX_FILE_SIZE (1*1024*1024)
 
+/* output buffer size */
+#define OUT_BUFF_SIZE (1100)
+
 typedef struct userParam
 {
     int fd;
+    useconds_t storageDelay; /* simulated time to store a block */
+    /* asynchronous commit: one block at a time is written by the writer thread */
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    const uint8_t *jobBuf; /* block to write, NULL when idle */
+    size_t jobSz;
+    int32_t jobRes;
+    /* zero copy: block being received into the file, through a mapping */
+    uint8_t *map;
+    size_t mapLen;
+    off_t blkStart; /* file size before the block */
+    size_t outLen; /* bytes waiting in outBuf */
+    uint8_t outBuf[OUT_BUFF_SIZE];
 }userParam_t;
 
 
@@ -42,7 +63,7 @@ static size_t usr_maxFileSize()
 
 static int32_t usr_ReceiveStart(userParam_t *param, const char * filename)
 {
-    param->fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    param->fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
     if(-1 != param->fd)
     {
         return 0;
@@ -53,6 +74,10 @@ static int32_t usr_ReceiveStart(userParam_t *param, const char * filename)
 static int32_t usr_ProcessData(userParam_t *param, const uint8_t *buffer, size_t buffSz)
 {
     int written;
+    if(param->storageDelay > 0)
+    {
+        usleep(param->storageDelay);
+    }
     written = write(param->fd, buffer,buffSz);
     if(written == buffSz)
     {
@@ -61,6 +86,92 @@ static int32_t usr_ProcessData(userParam_t *param, const uint8_t *buffer, size_t
     return -1;
 }
 
+/* with YM_RX_MIN_RAM data are written in chunks before the block is checked */
+static int32_t usr_Rollback(userParam_t *param, size_t offset)
+{
+    if((0 != ftruncate(param->fd, offset)) || (offset != lseek(param->fd, offset, SEEK_SET)))
+    {
+        return -1;
+    }
+    return 0;
+}
+
+/* map the part of the file where the block goes */
+static uint8_t *usr_AcquireBlockBuffer(userParam_t *param, size_t offset, size_t maxLen)
+{
+    size_t pageOfs = offset % sysconf(_SC_PAGESIZE);
+
+    param->blkStart = offset;
+    if(0 != ftruncate(param->fd, offset + maxLen))
+    {
+        return NULL;
+    }
+    param->mapLen = pageOfs + maxLen;
+    param->map = mmap(NULL, param->mapLen, PROT_READ | PROT_WRITE, MAP_SHARED, param->fd, offset - pageOfs);
+    if(MAP_FAILED == param->map)
+    {
+        return NULL;
+    }
+    return param->map + pageOfs;
+}
+
+static int32_t usr_ReleaseBlockBuffer(userParam_t *param, int ok)
+{
+    munmap(param->map, param->mapLen);
+    if(!ok) /* drop the damaged block */
+    {
+        return ftruncate(param->fd, param->blkStart);
+    }
+    if(param->storageDelay > 0)
+    {
+        usleep(param->storageDelay);
+    }
+    return 0;
+}
+
+static void *usr_writer(void *arg)
+{
+    userParam_t *param = arg;
+
+    pthread_mutex_lock(&param->lock);
+    for(;;)
+    {
+        while(NULL == param->jobBuf)
+        {
+            pthread_cond_wait(&param->cond, &param->lock);
+        }
+        pthread_mutex_unlock(&param->lock);
+        int32_t res = usr_ProcessData(param, param->jobBuf, param->jobSz);
+        pthread_mutex_lock(&param->lock);
+        param->jobRes = res;
+        param->jobBuf = NULL;
+        pthread_cond_broadcast(&param->cond);
+    }
+    return NULL;
+}
+
+/* the block stays in the receiver buffer until usr_CommitWait() returns */
+static int32_t usr_ProcessDataAsync(userParam_t *param, const uint8_t *buffer, size_t buffSz)
+{
+    pthread_mutex_lock(&param->lock);
+    param->jobBuf = buffer;
+    param->jobSz = buffSz;
+    pthread_cond_broadcast(&param->cond);
+    pthread_mutex_unlock(&param->lock);
+    return 0;
+}
+
+static int32_t usr_CommitWait(userParam_t *param)
+{
+    pthread_mutex_lock(&param->lock);
+    while(NULL != param->jobBuf)
+    {
+        pthread_cond_wait(&param->cond, &param->lock);
+    }
+    pthread_mutex_unlock(&param->lock);
+    return param->jobRes;
+}
+
 static int32_t usr_ReceiveEnd(userParam_t *param)
 {
     close(param->fd);
@@ -68,11 +179,11 @@ static int32_t usr_ReceiveEnd(userParam_t *param)
     return 0;
 }
 
-static int usr_getByte(userParam_t *param, uint32_t tout)
+static int32_t usr_getBytes(userParam_t *param, uint8_t *buf, size_t len, uint32_t tout)
 {
     struct timeval tv;
     fd_set readfds;
-    uint8_t charBuf;
+    ssize_t n;
 
     // Imposta il timeout
     tv.tv_sec = tout/1000;
@@ -92,37 +203,208 @@ static int usr_getByte(userParam_t *param, uint32_t tout)
         return -1;
     case 0:
         // fprintf(stderr, "timeout\n");
-        return -1;
+        return 0;
     default:
-        if (read(STDIN_FILENO, &charBuf, 1) < 0)
+        // legge tutti i byte gia' disponibili, fino a len
+        n = read(STDIN_FILENO, buf, len);
+        if (n < 0)
         {
             perror("read()");
             return -1;
         }
-        // fprintf(stderr, "%c", charBuf);
-        return charBuf;
+        if (0 == n) // pronto ma vuoto: end of file, il sender non c'e' piu'
+        {
+            return -1;
+        }
+        return n;
     }
 }
 
+static int usr_getByte(userParam_t *param, uint32_t tout)
+{
+    uint8_t charBuf;
+
+    int32_t n = usr_getBytes(param, &charBuf, 1, tout);
+
+    if (n <= 0)
+    {
+        return (0 == n) ? -1 : -2; // -1 timeout, -2 errore
+    }
+    return charBuf;
+}
+
 static void usr_putByte(userParam_t *param, uint8_t c)
 {
     write(STDOUT_FILENO, &c, 1);
 }
 
+static void usr_flush(userParam_t *param)
+{
+    if (param->outLen > 0)
+    {
+        write(STDOUT_FILENO, param->outBuf, param->outLen);
+        param->outLen = 0;
+    }
+}
+
+static void usr_putBytes(userParam_t *param, const uint8_t *buf, size_t len)
+{
+    if (param->outLen + len > sizeof(param->outBuf))
+    {
+        usr_flush(param);
+    }
+    if (len > sizeof(param->outBuf)) /* too big to be buffered */
+    {
+        write(STDOUT_FILENO, buf, len);
+        return;
+    }
+    memcpy(&param->outBuf[param->outLen], buf, len);
+    param->outLen += len;
+}
+
+static uint32_t usr_getTime()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
 
-int main()
+int main(int argc, char *argv[])
 {
     int ret = 0;
     ymodem_desc_t *ymHdl;
+    ymodem_mode_t mode = ymMode_crc;
+    int window = YM_WINDOW_MAX;
+    int async = 0;
+    int zeroCopy = 0;
+    ymodem_timing_t timing = YM_TIMING_DEFAULT;
+    size_t blockSize = YM_MAX_BLOCK_SIZE;
+    const char *traceFile = NULL;
+    int opt;
+
+    while (-1 != (opt = getopt(argc, argv, "gw:as:zt:k:p:b:c:T:")))
+    {
+        switch (opt)
+        {
+        case 'g': /* YMODEM-g */
+            mode = ymMode_g;
+            break;
+        case 'w': /* largest window accepted */
+            window = atoi(optarg);
+            break;
+        case 'a': /* store blocks while the next ones are received */
+            async = 1;
+            break;
+        case 's': /* slow storage: ms to store a block */
+            usrParam.storageDelay = atoi(optarg) * 1000;
+            break;
+        case 'z': /* receive blocks straight into the file */
+            zeroCopy = 1;
+            break;
+        case 't': /* adaptive timeouts, not shorter than this */
+            timing.minTimeout = atoi(optarg);
+            break;
+        case 'k': /* wait for a block, NAKing it when it expires */
+            timing.pktTimeout = atoi(optarg);
+            break;
+        case 'p': /* quiet line ending the purge after a broken block, 0: NAK at once */
+            timing.purgeGap = atoi(optarg);
+            break;
+        case 'b': /* largest block accepted */
+            blockSize = atoi(optarg);
+            break;
+        case 'c': /* ask for a file again after this, then doubling, 0: every pktTimeout */
+            timing.pollInterval = atoi(optarg);
+            break;
+        case 'T': /* dump the trace ring here at the end */
+            traceFile = optarg;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-g] [-w window] [-a] [-s storage_ms] [-z] [-t min_timeout_ms] [-k pkt_timeout_ms] [-p purge_gap_ms] [-b block_size] [-c poll_ms] [-T trace_file]\n", argv[0]);
+            return 1;
+        }
+    }
 
     ymHdl = ymodem_init(&staticYmBuff, &usrParam,
             (ymodem_maxFileSize_t)usr_maxFileSize,
             (ymodem_receiveStart_t)usr_ReceiveStart,
-            (ymodem_processData_t)usr_ProcessData,
+            (ymodem_processData_t)(async ? usr_ProcessDataAsync : usr_ProcessData),
             (ymodem_receiveEnd_t)usr_ReceiveEnd,
             (ymodem_getByte_t)usr_getByte,
-            (ymodem_putByte_t)usr_putByte);
+            (ymodem_getBytes_t)usr_getBytes,
+            (ymodem_putByte_t)usr_putByte,
+            (ymodem_putBytes_t)usr_putBytes,
+            (ymodem_flush_t)usr_flush);
+    ymodem_set_mode(ymHdl, mode);
+    ymodem_set_window(ymHdl, window);
+    ymodem_set_block_size(ymHdl, blockSize);
+    ymodem_set_timing(ymHdl, &timing, (ymodem_getTime_t)usr_getTime);
+    ymodem_set_rollback(ymHdl, (ymodem_rollback_t)usr_Rollback);
+    if(zeroCopy)
+    {
+        ymodem_set_block_buffers(ymHdl, (ymodem_acquireBlockBuffer_t)usr_AcquireBlockBuffer,
+                (ymodem_releaseBlockBuffer_t)usr_ReleaseBlockBuffer);
+    }
+    if(async)
+    {
+        pthread_t writer;
+        pthread_mutex_init(&usrParam.lock, NULL);
+        pthread_cond_init(&usrParam.cond, NULL);
+        if((0 != ymodem_set_async_commit(ymHdl, (ymodem_commitWait_t)usr_CommitWait)) ||
+            (0 != pthread_create(&writer, NULL, usr_writer, &usrParam)))
+        {
+            fprintf(stderr, "asynchronous commit not available\n");
+            return 1;
+        }
+    }
     ret = ymodem_receive(ymHdl);
     fprintf(stderr, "ret %d\n", ret);
+
+    if(NULL != traceFile)
+    {
+#if YM_TRACE_LEVEL > 0
+        FILE *f = fopen(traceFile, "wb");
+        if((NULL == f) || (1 != fwrite(ymodem_trace_ring(), sizeof(ymodem_trace_ring_t), 1, f)))
+        {
+            perror(traceFile);
+        }
+        if(NULL != f)
+        {
+            fclose(f);
+        }
+#else
+        fprintf(stderr, "no trace: build with YM_TRACE_LEVEL\n");
+#endif
+    }
+
+#if YM_RX_STATS
+    ymodem_stats_t st;
+    ymodem_get_stats(ymHdl, &st);
+    fprintf(stderr, "%u files, %u blocks, %u bytes; errors: %u timeout, %u crc, %u header, %u sequence; "
+            "%u duplicates, %u cancels, %u retries; last file: %u retries, %u ms\n",
+            st.files, st.blocks, st.bytes, st.timeouts, st.crcErrors, st.headerErrors, st.seqErrors,
+            st.duplicates, st.cancels, st.retries, st.fileRetries, st.fileTime);
+#endif
+
+#if YM_RX_PROFILE
+    /* one line per phase: blocks by upper bound of their time in ns */
+    static const char * const phaseNames[ymPhase_count] = { "wait", "payload", "crc", "store", "turnaround" };
+    ymodem_profile_t prof;
+    ymodem_get_profile(ymHdl, &prof);
+    for(int ph=0;ph<ymPhase_count;ph++)
+    {
+        fprintf(stderr, "%-10s ns:", phaseNames[ph]);
+        for(int b=0;b<YM_PROF_BINS;b++)
+        {
+            if(0 != prof.hist[ph][b])
+            {
+                fprintf(stderr, " <%llu:%u", 1ull << b, prof.hist[ph][b]);
+            }
+        }
+        fprintf(stderr, "\n");
+    }
+#endif
     return 0;
 }
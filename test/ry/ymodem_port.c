@@ -15,6 +15,7 @@
 #include "ymodem_port.h"
 #include <ctype.h>
 #include <stddef.h>
+#include <time.h>
 
 
 char *ymodem_port_stpncpy(char *dst, const char *src, size_t sz)
@@ -85,3 +86,11 @@ int ymodem_port_atoi (const char *nptr)
     return result * sign;
 }
 
+
+uint32_t ymodem_port_ticks(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)((uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec);
+}
@@ -26,8 +26,13 @@
 /**
  * @brief log function
  *
+ * off when events go to the trace ring (YM_TRACE_LEVEL), formatting every block would cost too much
  */
+#if YM_TRACE_LEVEL > 0
+#define ymodem_log(...)
+#else
 #define ymodem_log(...) fprintf(stderr, __VA_ARGS__)
+#endif
 
 
 /**
@@ -86,4 +91,11 @@ void *ymodem_port_memchr(const void *s, int c, size_t n) __attribute__((nonnull
 int ymodem_port_atoi(const char *nptr) __attribute__((nonnull (1)));
 
 
+/**
+ * @brief free running counter timing the receiver phases (YM_RX_PROFILE) and trace records (YM_TRACE_LEVEL)
+ *
+ * ns of the monotonic clock: phases longer than about 4 s wrap
+ */
+uint32_t ymodem_port_ticks(void);
+
 #endif /* TEST_RY_YMODEM_PORT_H */
@@ -0,0 +1,75 @@
+#!/bin/sh
+#
+# Copyright 2024 Massimiliano Cialdi
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# ryd load benchmark: aggregate throughput versus number of ports
+#
+# for every port count N, N socat pty pairs are created, ryd receives on one
+# end of each pair and N senders push the same file on the other ends.
+# Output is CSV on stdout.
+#
+# environment:
+#   PORTS    port counts to test (default "1 2 4 8 16 32 64")
+#   SIZE_KIB size of the file sent on every port (default 1024)
+#   WORKERS  ryd worker threads (default 1)
+#   SENDER   sender command, file name is appended (default test/sy/sy)
+
+. "$(dirname "$0")/../benchlib.sh"
+
+PORTS=${PORTS:-"1 2 4 8 16 32 64"}
+SIZE_KIB=${SIZE_KIB:-1024}
+WORKERS=${WORKERS:-1}
+SENDER=${SENDER:-$SY}
+RYD=$BENCH_DIR/ryd/ryd
+
+bench_init ryd-bench
+bench_payload "$SIZE_KIB"
+
+echo "ports,workers,bytes,seconds,aggregate_KiBps,per_port_KiBps"
+for n in $PORTS; do
+    rm -rf "$TMP/out" "$TMP"/tty*
+    socatPids=""
+    ports=""
+    i=0
+    while [ $i -lt $n ]; do
+        socat pty,raw,echo=0,link="$TMP/ttyS$i" pty,raw,echo=0,link="$TMP/ttyR$i" &
+        socatPids="$socatPids $!"
+        ports="$ports $TMP/ttyR$i"
+        i=$((i + 1))
+    done
+    for port in $ports; do
+        bench_wait_file "$port"
+    done
+    "$RYD" -1 -j "$WORKERS" -o "$TMP/out" $ports 2>"$TMP/ryd.log" &
+    rydPid=$!
+
+    start=$(bench_now)
+    senderPids=""
+    i=0
+    while [ $i -lt $n ]; do
+        (cd "$TMP" && $SENDER payload <"$TMP/ttyS$i" >"$TMP/ttyS$i" 2>/dev/null) &
+        senderPids="$senderPids $!"
+        i=$((i + 1))
+    done
+    wait $senderPids
+    wait $rydPid
+    end=$(bench_now)
+
+    kill $socatPids 2>/dev/null
+    wait $socatPids 2>/dev/null
+
+    bytes=$((n * SIZE_KIB * 1024))
+    secs=$(bench_secs "$start" "$end")
+    echo "$n,$WORKERS,$bytes,$secs,$(bench_kibps "$bytes" "$secs"),$(bench_kibps $((SIZE_KIB * 1024)) "$secs")"
+done
@@ -0,0 +1,577 @@
+/*
+ * Copyright 2024 Massimiliano Cialdi
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * ryd: multi-session ymodem receiver
+ *
+ * one receiving session per serial port, all driven by the non-blocking API
+ * (ymodem_rx_feed()/ymodem_rx_poll()) from an epoll loop. When there are more
+ * ports than a core can serve, ports are spread over a small pool of worker
+ * threads, each pinned to a core and running its own epoll loop. A port which
+ * hangs up is closed and opened again every REOPEN_MS.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sched.h>
+#include <termios.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/stat.h>
+#include "ymodem.h"
+
+/* default max file size supported in byte */
+#define MAX_FILE_SIZE (64*1024*1024)
+
+/* output buffer size */
+#define OUT_BUFF_SIZE (1100)
+
+/* bytes read from a port in one go */
+#define IN_BUFF_SIZE (4096)
+
+#define MAX_EVENTS (64)
+
+/* a port lost (hang up, end of file) is opened again after this */
+#define REOPEN_MS (1000)
+
+typedef struct session
+{
+    staticYmodem_t ymBuff; /* every session has its own handle */
+    ymodem_desc_t *ymHdl;
+    const char *port; /* tty path */
+    int ttyFd; /* -1 while the port is lost */
+    int epFd; /* epoll set of the worker serving the port */
+    int outWatched; /* EPOLLOUT requested: outBuf waits for the tty to drain */
+    uint32_t reopenAt; /* port lost: when to try opening it again */
+    int dirFd; /* per port output directory */
+    int fileFd; /* file being received */
+    size_t maxFileSize;
+    int active; /* session in progress */
+    int result; /* result of the last session */
+    unsigned files; /* files received */
+    uint64_t bytes; /* bytes received */
+    uint64_t startMs; /* start of the first file */
+    uint64_t endMs; /* end of the last file */
+    size_t outLen; /* bytes waiting in outBuf */
+    uint8_t outBuf[OUT_BUFF_SIZE];
+}session_t;
+
+typedef struct worker
+{
+    pthread_t thread;
+    int cpu; /* core the worker is pinned to, -1 to not pin */
+    int epFd;
+    session_t **sessions;
+    size_t nSessions;
+}worker_t;
+
+static volatile sig_atomic_t stopRequested;
+
+static int oneShot; /* exit once every port has completed one session */
+
+static ymodem_mode_t mode = ymMode_crc;
+
+static ymodem_timing_t timing = YM_TIMING_DEFAULT;
+
+static uint64_t now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static size_t usr_maxFileSize(session_t *s)
+{
+    return s->maxFileSize;
+}
+
+static int32_t usr_ReceiveStart(session_t *s, const char *filename)
+{
+    /* never write outside the port directory */
+    const char *name = strrchr(filename, '/');
+    name = (NULL != name) ? name + 1 : filename;
+    if((0 == name[0]) || (0 == strcmp(name, ".")) || (0 == strcmp(name, "..")))
+    {
+        return -1;
+    }
+
+    s->fileFd = openat(s->dirFd, name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(-1 == s->fileFd)
+    {
+        return -1;
+    }
+    if(0 == s->files)
+    {
+        s->startMs = now_ms();
+    }
+    return 0;
+}
+
+static int32_t usr_ProcessData(session_t *s, const uint8_t *buffer, size_t buffSz)
+{
+    ssize_t written;
+
+    written = write(s->fileFd, buffer, buffSz);
+    if(written != (ssize_t)buffSz)
+    {
+        return -1;
+    }
+    s->bytes += buffSz;
+    return 0;
+}
+
+static int32_t usr_ReceiveEnd(session_t *s)
+{
+    close(s->fileFd);
+    s->fileFd = -1;
+    s->files++;
+    s->endMs = now_ms();
+    return 0;
+}
+
+/* ask the worker loop for EPOLLOUT while output is waiting */
+static void session_watch_out(session_t *s, int watch)
+{
+    if(watch != s->outWatched)
+    {
+        struct epoll_event ev = { .events = EPOLLIN | (watch ? EPOLLOUT : 0), .data.ptr = s };
+        epoll_ctl(s->epFd, EPOLL_CTL_MOD, s->ttyFd, &ev);
+        s->outWatched = watch;
+    }
+}
+
+/* write what the tty takes, the rest is sent when the loop gets EPOLLOUT */
+static void usr_flush(session_t *s)
+{
+    size_t sent = 0;
+
+    while(sent < s->outLen)
+    {
+        ssize_t n = write(s->ttyFd, &s->outBuf[sent], s->outLen - sent);
+        if(n < 0)
+        {
+            if(EINTR == errno)
+            {
+                continue;
+            }
+            if(EAGAIN != errno) /* the port is gone, reading it will tell */
+            {
+                sent = s->outLen;
+            }
+            break;
+        }
+        sent += n;
+    }
+    memmove(s->outBuf, &s->outBuf[sent], s->outLen - sent);
+    s->outLen -= sent;
+    session_watch_out(s, s->outLen > 0);
+}
+
+static void usr_putBytes(session_t *s, const uint8_t *buf, size_t len)
+{
+    while(len > 0)
+    {
+        if(s->outLen == sizeof(s->outBuf))
+        {
+            usr_flush(s);
+            if(s->outLen == sizeof(s->outBuf)) /* the tty doesn't drain: drop, the sender will time out */
+            {
+                return;
+            }
+        }
+        size_t chunk = sizeof(s->outBuf) - s->outLen;
+        chunk = (len < chunk) ? len : chunk;
+        memcpy(&s->outBuf[s->outLen], buf, chunk);
+        s->outLen += chunk;
+        buf += chunk;
+        len -= chunk;
+    }
+}
+
+/* open the tty in raw mode */
+static int port_open(session_t *s)
+{
+    s->ttyFd = open(s->port, O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if(-1 == s->ttyFd)
+    {
+        return -1;
+    }
+    if(isatty(s->ttyFd))
+    {
+        struct termios tio;
+        if(0 == tcgetattr(s->ttyFd, &tio))
+        {
+            cfmakeraw(&tio);
+            tcsetattr(s->ttyFd, TCSANOW, &tio);
+        }
+    }
+    return 0;
+}
+
+static int session_open(session_t *s, const char *port, const char *outDir, size_t maxFileSize)
+{
+    s->port = port;
+    s->fileFd = -1;
+    s->maxFileSize = maxFileSize;
+
+    if(0 != port_open(s))
+    {
+        perror(port);
+        return -1;
+    }
+
+    /* per port output directory: <outDir>/<tty name> */
+    const char *name = strrchr(port, '/');
+    name = (NULL != name) ? name + 1 : port;
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", outDir, name);
+    if((0 != mkdir(path, 0755)) && (EEXIST != errno))
+    {
+        perror(path);
+        return -1;
+    }
+    s->dirFd = open(path, O_RDONLY | O_DIRECTORY);
+    if(-1 == s->dirFd)
+    {
+        perror(path);
+        return -1;
+    }
+
+    s->ymHdl = ymodem_init(&s->ymBuff, s,
+            (ymodem_maxFileSize_t)usr_maxFileSize,
+            (ymodem_receiveStart_t)usr_ReceiveStart,
+            (ymodem_processData_t)usr_ProcessData,
+            (ymodem_receiveEnd_t)usr_ReceiveEnd,
+            NULL, /* bytes are pushed with ymodem_rx_feed() */
+            NULL,
+            NULL,
+            (ymodem_putBytes_t)usr_putBytes,
+            (ymodem_flush_t)usr_flush);
+    if(NULL == s->ymHdl)
+    {
+        return -1;
+    }
+    ymodem_set_mode(s->ymHdl, mode);
+    ymodem_set_timing(s->ymHdl, &timing, NULL); /* the time comes from the loop */
+    return 0;
+}
+
+/* a session is over: restart it, or retire the port in one shot mode */
+static void session_end(worker_t *w, session_t *s, ymodem_rxStatus_t status, uint32_t now)
+{
+    ymodem_stats_t st;
+
+    ymodem_get_stats(s->ymHdl, &st);
+    fprintf(stderr, "%s: session ret %d, %u files, %u blocks; errors: %u timeout, %u crc, %u header, %u sequence; "
+            "%u duplicates, %u retries\n", s->port, status, st.files, st.blocks,
+            st.timeouts, st.crcErrors, st.headerErrors, st.seqErrors, st.duplicates, st.retries);
+    s->result = status;
+    if(!oneShot)
+    {
+        if(-1 == s->ttyFd) /* the next session waits for the port */
+        {
+            s->reopenAt = now + REOPEN_MS;
+            return;
+        }
+        ymodem_rx_start(s->ymHdl, now);
+        return;
+    }
+    s->active = 0;
+    if(-1 != s->ttyFd)
+    {
+        epoll_ctl(w->epFd, EPOLL_CTL_DEL, s->ttyFd, NULL);
+    }
+}
+
+/* hang up, end of file or error on the port: the session can't go on, nor the port be polled */
+static void session_lost(worker_t *w, session_t *s, uint32_t now)
+{
+    fprintf(stderr, "%s: port lost\n", s->port);
+    ymodem_rxStatus_t status = ymodem_rx_cancel(s->ymHdl);
+    epoll_ctl(w->epFd, EPOLL_CTL_DEL, s->ttyFd, NULL);
+    close(s->ttyFd);
+    s->ttyFd = -1;
+    s->outLen = 0;
+    s->outWatched = 0;
+    session_end(w, s, status, now);
+}
+
+/* add the port to the worker loop and start a session on it */
+static void session_start(worker_t *w, session_t *s, uint32_t now)
+{
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = s };
+    s->epFd = w->epFd;
+    epoll_ctl(w->epFd, EPOLL_CTL_ADD, s->ttyFd, &ev);
+    ymodem_rx_start(s->ymHdl, now);
+}
+
+static void *worker_run(void *arg)
+{
+    worker_t *w = arg;
+    struct epoll_event events[MAX_EVENTS];
+    uint8_t buf[IN_BUFF_SIZE];
+    size_t active;
+
+    if(w->cpu >= 0)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(w->cpu, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+
+    uint32_t now = (uint32_t)now_ms();
+    for(size_t i=0;i<w->nSessions;i++)
+    {
+        session_t *s = w->sessions[i];
+        s->active = 1;
+        session_start(w, s, now);
+    }
+    active = w->nSessions;
+
+    while((active > 0) && !stopRequested)
+    {
+        /* sleep until the nearest timeout */
+        uint32_t tout = UINT32_MAX;
+        for(size_t i=0;i<w->nSessions;i++)
+        {
+            session_t *s = w->sessions[i];
+            if(s->active)
+            {
+                uint32_t t = (-1 != s->ttyFd) ? ymodem_rx_timeout(s->ymHdl, now) :
+                             ((int32_t)(s->reopenAt - now) > 0) ? s->reopenAt - now : 0;
+                tout = t < tout ? t : tout;
+            }
+        }
+
+        int n = epoll_wait(w->epFd, events, MAX_EVENTS, (int)tout);
+        if((n < 0) && (EINTR != errno))
+        {
+            perror("epoll_wait()");
+            break;
+        }
+        now = (uint32_t)now_ms();
+
+        for(int e=0;e<n;e++)
+        {
+            session_t *s = events[e].data.ptr;
+            uint32_t evs = events[e].events;
+            if(evs & EPOLLOUT)
+            {
+                usr_flush(s);
+            }
+            if(0 == (evs & (EPOLLIN | EPOLLHUP | EPOLLERR)))
+            {
+                continue;
+            }
+            ssize_t len = read(s->ttyFd, buf, sizeof(buf));
+            if(len > 0)
+            {
+                ymodem_rxStatus_t status = ymodem_rx_feed(s->ymHdl, buf, len, now);
+                if(ymRxStatus_busy != status)
+                {
+                    session_end(w, s, status, now);
+                }
+            }
+            else if((0 == len) || ((EAGAIN != errno) && (EINTR != errno)) || (evs & (EPOLLHUP | EPOLLERR)))
+            {
+                session_lost(w, s, now); /* level triggered: left in the set it would wake the loop forever */
+            }
+        }
+
+        /* handle timeouts */
+        active = 0;
+        for(size_t i=0;i<w->nSessions;i++)
+        {
+            session_t *s = w->sessions[i];
+            if(!s->active)
+            {
+                continue;
+            }
+            if(-1 == s->ttyFd)
+            {
+                if((int32_t)(now - s->reopenAt) >= 0)
+                {
+                    if(0 == port_open(s))
+                    {
+                        fprintf(stderr, "%s: port back\n", s->port);
+                        session_start(w, s, now);
+                    }
+                    else
+                    {
+                        s->reopenAt = now + REOPEN_MS;
+                    }
+                }
+                active++;
+                continue;
+            }
+            ymodem_rxStatus_t status = ymodem_rx_poll(s->ymHdl, now);
+            if(ymRxStatus_busy != status)
+            {
+                session_end(w, s, status, now);
+            }
+            active += s->active;
+        }
+    }
+    return NULL;
+}
+
+static void on_signal(int sig)
+{
+    stopRequested = 1;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [-o outdir] [-j workers] [-m maxsize] [-g] [-t min_timeout_ms] [-1] tty...\n"
+            "  -o outdir   base output directory, one subdirectory per port (default .)\n"
+            "  -j workers  number of worker threads, each pinned to a core (default 1)\n"
+            "  -m maxsize  max file size in bytes (default %d)\n"
+            "  -g          YMODEM-g (streaming, for error free links)\n"
+            "  -t ms       adaptive timeouts, not shorter than ms\n"
+            "  -1          exit once every port has completed a session\n",
+            prog, MAX_FILE_SIZE);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *outDir = ".";
+    size_t maxFileSize = MAX_FILE_SIZE;
+    long nWorkers = 1;
+    int opt;
+
+    while(-1 != (opt = getopt(argc, argv, "o:j:m:gt:1h")))
+    {
+        switch(opt)
+        {
+        case 'o':
+            outDir = optarg;
+            break;
+        case 'j':
+            nWorkers = strtol(optarg, NULL, 0);
+            break;
+        case 'm':
+            maxFileSize = strtoul(optarg, NULL, 0);
+            break;
+        case 'g':
+            mode = ymMode_g;
+            break;
+        case 't':
+            timing.minTimeout = strtoul(optarg, NULL, 0);
+            break;
+        case '1':
+            oneShot = 1;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    size_t nPorts = argc - optind;
+    if((0 == nPorts) || (nWorkers < 1))
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    if((size_t)nWorkers > nPorts)
+    {
+        nWorkers = nPorts;
+    }
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    signal(SIGPIPE, SIG_IGN);
+
+    session_t *sessions = calloc(nPorts, sizeof(session_t));
+    worker_t *workers = calloc(nWorkers, sizeof(worker_t));
+    session_t **slots = calloc(nPorts, sizeof(session_t *));
+    if((NULL == sessions) || (NULL == workers) || (NULL == slots))
+    {
+        perror("calloc()");
+        return 1;
+    }
+    if((0 != mkdir(outDir, 0755)) && (EEXIST != errno))
+    {
+        perror(outDir);
+        return 1;
+    }
+    for(size_t i=0;i<nPorts;i++)
+    {
+        if(0 != session_open(&sessions[i], argv[optind + i], outDir, maxFileSize))
+        {
+            return 1;
+        }
+    }
+
+    /* ports are spread round robin over the workers */
+    long nCpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t slot = 0;
+    for(long w=0;w<nWorkers;w++)
+    {
+        workers[w].cpu = (nWorkers > 1) ? (int)(w % nCpus) : -1;
+        workers[w].epFd = epoll_create1(0);
+        workers[w].sessions = &slots[slot];
+        for(size_t i=w;i<nPorts;i+=nWorkers)
+        {
+            slots[slot++] = &sessions[i];
+            workers[w].nSessions++;
+        }
+    }
+
+    uint64_t startMs = now_ms();
+    if(1 == nWorkers)
+    {
+        worker_run(&workers[0]);
+    }
+    else
+    {
+        for(long w=0;w<nWorkers;w++)
+        {
+            pthread_create(&workers[w].thread, NULL, worker_run, &workers[w]);
+        }
+        for(long w=0;w<nWorkers;w++)
+        {
+            pthread_join(workers[w].thread, NULL);
+        }
+    }
+    uint64_t elapsedMs = now_ms() - startMs;
+
+    /* summary */
+    uint64_t totBytes = 0;
+    int ret = 0;
+    for(size_t i=0;i<nPorts;i++)
+    {
+        session_t *s = &sessions[i];
+        uint64_t ms = s->endMs - s->startMs;
+        fprintf(stderr, "%s: ret %d, %u files, %llu bytes, %llu ms\n", s->port, s->result, s->files,
+                (unsigned long long)s->bytes, (unsigned long long)ms);
+        totBytes += s->bytes;
+        ret |= s->result;
+    }
+    fprintf(stderr, "total: %zu ports, %llu bytes, %llu ms, %.1f KiB/s\n", nPorts,
+            (unsigned long long)totBytes, (unsigned long long)elapsedMs,
+            elapsedMs ? (totBytes / 1024.0) / (elapsedMs / 1000.0) : 0.0);
+    return ret;
+}
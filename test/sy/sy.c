@@ -0,0 +1,177 @@
+/*
+ * Copyright 2024 Massimiliano Cialdi
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/*
+ * sy: ymodem sender
+ *
+ * sends the files given on the command line through stdin/stdout, like `sb` does
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <libgen.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/stat.h>
+#include "ymodem.h"
+
+typedef struct userParam
+{
+    int fd;
+    char **files; /* files still to send */
+    int filesLeft;
+}userParam_t;
+
+
+static staticYmodemTx_t staticYmBuff;
+
+static userParam_t usrParam;
+
+static int32_t usr_SendStart(userParam_t *param, char *filename, size_t filenameSz, size_t *filesize)
+{
+    struct stat st;
+
+    if (0 == param->filesLeft)
+    {
+        return 1; /* end of batch */
+    }
+    char *path = *param->files++;
+    param->filesLeft--;
+
+    param->fd = open(path, O_RDONLY);
+    if ((-1 == param->fd) || (0 != fstat(param->fd, &st)))
+    {
+        perror(path);
+        return -1;
+    }
+    strncpy(filename, basename(path), filenameSz);
+    *filesize = st.st_size;
+    return 0;
+}
+
+static int32_t usr_ReadData(userParam_t *param, uint8_t *buffer, size_t buffSz)
+{
+    size_t len = 0;
+
+    /* fill the whole buffer, short reads happen only at end of file */
+    while (len < buffSz)
+    {
+        ssize_t n = read(param->fd, &buffer[len], buffSz - len);
+        if (n < 0)
+        {
+            perror("read()");
+            return -1;
+        }
+        if (0 == n)
+        {
+            break;
+        }
+        len += n;
+    }
+    return len;
+}
+
+static int32_t usr_SendEnd(userParam_t *param)
+{
+    close(param->fd);
+    param->fd = -1;
+    return 0;
+}
+
+static int32_t usr_getBytes(userParam_t *param, uint8_t *buf, size_t len, uint32_t tout)
+{
+    struct timeval tv;
+    fd_set readfds;
+    ssize_t n;
+
+    tv.tv_sec = tout/1000;
+    tv.tv_usec = (tout%1000)*1000;
+
+    FD_ZERO(&readfds);
+    FD_SET(STDIN_FILENO, &readfds);
+
+    switch(select(STDIN_FILENO + 1, &readfds, NULL, NULL, &tv))
+    {
+    case -1:
+        perror("select()");
+        return -1;
+    case 0:
+        return 0;
+    default:
+        n = read(STDIN_FILENO, buf, len);
+        if (n < 0)
+        {
+            perror("read()");
+            return -1;
+        }
+        return n;
+    }
+}
+
+/* frames are written as a whole, there is nothing to buffer */
+static void usr_putBytes(userParam_t *param, const uint8_t *buf, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t n = write(STDOUT_FILENO, buf, len);
+        if (n < 0)
+        {
+            perror("write()");
+            return;
+        }
+        buf += n;
+        len -= n;
+    }
+}
+
+static uint32_t usr_getTime()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+int main(int argc, char *argv[])
+{
+    int ret = 0;
+    ymodem_tx_desc_t *ymTxHdl;
+    ymodem_timing_t timing = YM_TIMING_DEFAULT;
+
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s file...\n", argv[0]);
+        return 1;
+    }
+    usrParam.fd = -1;
+    usrParam.files = &argv[1];
+    usrParam.filesLeft = argc - 1;
+
+    ymTxHdl = ymodem_tx_init(&staticYmBuff, &usrParam,
+            (ymodem_sendStart_t)usr_SendStart,
+            (ymodem_readData_t)usr_ReadData,
+            (ymodem_sendEnd_t)usr_SendEnd,
+            NULL,
+            (ymodem_getBytes_t)usr_getBytes,
+            NULL,
+            (ymodem_putBytes_t)usr_putBytes,
+            NULL);
+    ymodem_tx_set_timing(ymTxHdl, &timing, (ymodem_getTime_t)usr_getTime);
+    ret = ymodem_send(ymTxHdl);
+    fprintf(stderr, "ret %d\n", ret);
+    return ret;
+}
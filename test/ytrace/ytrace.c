@@ -0,0 +1,232 @@
+/*
+ * Copyright 2024 Massimiliano Cialdi
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * ytrace: decoder of the receiver trace ring
+ *
+ * reads a dump of ymodem_trace_ring_t (ry -T, or the memory of a target) and prints
+ * its records as text, the oldest first. The dump may come from a target of the other
+ * byte order, and kept any number of records: both are read from its header.
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "ymodem_trace.h"
+
+static const char * const eventNames[ymTrace_count] =
+{
+    [ymTrace_sessionStart] = "session start",
+    [ymTrace_sessionEnd] = "session end",
+    [ymTrace_fileStart] = "file start",
+    [ymTrace_fileEnd] = "file end",
+    [ymTrace_block] = "block",
+    [ymTrace_reply] = "reply",
+    [ymTrace_crcError] = "crc error",
+    [ymTrace_headerError] = "header error",
+    [ymTrace_seqError] = "sequence error",
+    [ymTrace_duplicate] = "duplicate",
+    [ymTrace_garbage] = "garbage",
+    [ymTrace_purge] = "purge",
+    [ymTrace_timeout] = "timeout",
+    [ymTrace_earlyTimeout] = "early timeout",
+    [ymTrace_truncated] = "truncated",
+    [ymTrace_cancel] = "cancel",
+    [ymTrace_abort] = "abort",
+    [ymTrace_noSender] = "no sender",
+};
+
+static uint32_t swap32(uint32_t v)
+{
+    return __builtin_bswap32(v);
+}
+
+/* protocol chars by name */
+static const char *char_name(uint16_t c, char *buf, size_t sz)
+{
+    switch(c)
+    {
+    case 0x01: return "SOH";
+    case 0x02: return "STX";
+    case 0x03: return "XTX";
+    case 0x04: return "EOT";
+    case 0x06: return "ACK";
+    case 0x15: return "NAK";
+    case 0x18: return "CAN";
+    case 'C': return "C";
+    case 'G': return "G";
+    default:
+        snprintf(buf, sz, "0x%02x", c);
+        return buf;
+    }
+}
+
+/* the argument of an event, as text */
+static void print_arg(const ymodem_trace_rec_t *rec)
+{
+    char buf[8];
+
+    switch(rec->event)
+    {
+    case ymTrace_sessionStart:
+        printf(" mode %s", (0 == rec->arg) ? "crc" : "g");
+        break;
+    case ymTrace_sessionEnd:
+        printf(" status %d", (int16_t)rec->arg);
+        break;
+    case ymTrace_fileStart:
+        printf(" window %u, block %u", rec->arg >> 8, (0 != (rec->arg & 0xff)) ? 1u << (rec->arg & 0xff) : 1024);
+        break;
+    case ymTrace_block:
+        printf(" %u bytes", rec->arg);
+        break;
+    case ymTrace_reply:
+    case ymTrace_garbage:
+        printf(" %s", char_name(rec->arg, buf, sizeof(buf)));
+        break;
+    case ymTrace_headerError:
+        printf(" complement 0x%02x", rec->arg);
+        break;
+    case ymTrace_seqError:
+        printf(" expected %u", rec->arg);
+        break;
+    case ymTrace_timeout:
+        printf(" after %u ms", rec->arg);
+        break;
+    case ymTrace_earlyTimeout:
+        printf(" %s", (0 != rec->arg) ? "inside a block" : "waiting a block");
+        break;
+    case ymTrace_truncated:
+        printf(" after %u bytes of the field", rec->arg);
+        break;
+    case ymTrace_abort:
+        printf(" after %u failures", rec->arg);
+        break;
+    default:
+        break;
+    }
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [-f ticks_per_ms] dump\n"
+            "  -f ticks_per_ms  print times in ms (default: raw ticks)\n",
+            prog);
+}
+
+int main(int argc, char *argv[])
+{
+    double ticksPerMs = 0.0;
+    int opt;
+
+    while(-1 != (opt = getopt(argc, argv, "f:h")))
+    {
+        switch(opt)
+        {
+        case 'f':
+            ticksPerMs = strtod(optarg, NULL);
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if(optind + 1 != argc)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    FILE *f = fopen(argv[optind], "rb");
+    if(NULL == f)
+    {
+        perror(argv[optind]);
+        return 1;
+    }
+
+    /* header, then as many records as it says */
+    uint32_t hdr[4];
+    if(1 != fread(hdr, sizeof(hdr), 1, f))
+    {
+        fprintf(stderr, "%s: too short\n", argv[optind]);
+        return 1;
+    }
+    int swapped = (YM_TRACE_MAGIC == swap32(hdr[0]));
+    if(!swapped && (YM_TRACE_MAGIC != hdr[0]))
+    {
+        fprintf(stderr, "%s: not a trace dump\n", argv[optind]);
+        return 1;
+    }
+    uint32_t records = swapped ? swap32(hdr[1]) : hdr[1];
+    uint32_t head = swapped ? swap32(hdr[2]) : hdr[2];
+    if((0 == records) || (0 != (records & (records - 1))))
+    {
+        fprintf(stderr, "%s: bad record count %u\n", argv[optind], records);
+        return 1;
+    }
+
+    ymodem_trace_rec_t *rec = calloc(records, sizeof(ymodem_trace_rec_t));
+    if((NULL == rec) || (records != fread(rec, sizeof(ymodem_trace_rec_t), records, f)))
+    {
+        fprintf(stderr, "%s: truncated\n", argv[optind]);
+        return 1;
+    }
+    fclose(f);
+
+    /* oldest record first: the ring has wrapped when more than records have been written */
+    uint32_t n = (head < records) ? head : records;
+    uint32_t first = head - n;
+    uint32_t t0 = 0;
+    uint32_t prev = 0;
+    printf("%u records written, %u kept\n", head, n);
+    for(uint32_t i=0;i<n;i++)
+    {
+        ymodem_trace_rec_t r = rec[(first + i) & (records - 1)];
+        if(swapped)
+        {
+            r.ticks = swap32(r.ticks);
+            r.arg = __builtin_bswap16(r.arg);
+        }
+        if(0 == i)
+        {
+            t0 = prev = r.ticks;
+        }
+        /* ticks wrap: differences are taken modulo 2^32 */
+        if(ticksPerMs > 0.0)
+        {
+            printf("%8u %12.3f ms %+10.3f ms  ", first + i, (uint32_t)(r.ticks - t0) / ticksPerMs,
+                    (uint32_t)(r.ticks - prev) / ticksPerMs);
+        }
+        else
+        {
+            printf("%8u %12u +%10u  ", first + i, (uint32_t)(r.ticks - t0), (uint32_t)(r.ticks - prev));
+        }
+        prev = r.ticks;
+        if(r.event < ymTrace_count)
+        {
+            printf("blk %3u  %s", r.blkNum, eventNames[r.event]);
+        }
+        else
+        {
+            printf("blk %3u  event %u", r.blkNum, r.event);
+        }
+        print_arg(&r);
+        printf("\n");
+    }
+    free(rec);
+    return 0;
+}
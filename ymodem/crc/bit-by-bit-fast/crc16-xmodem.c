@@ -52,3 +52,27 @@ crc16_xmodem_t crc16_xmodem_update(crc16_xmodem_t crc, const void *data, size_t
     }
     return crc & 0xffff;
 }
+
+
+crc16_xmodem_t crc16_xmodem_copy_update(crc16_xmodem_t crc, void *dst, const void *src, size_t data_len)
+{
+    const unsigned char *s = (const unsigned char *)src;
+    unsigned char *d = (unsigned char *)dst;
+    unsigned int i;
+    crc16_xmodem_t bit;
+    unsigned char c;
+
+    while (data_len--) {
+        c = *s++;
+        *d++ = c;
+        for (i = 0x80; i > 0; i >>= 1) {
+            bit = (crc & 0x8000) ^ ((c & i) ? 0x8000 : 0);
+            crc <<= 1;
+            if (bit) {
+                crc ^= 0x1021;
+            }
+        }
+        crc &= 0xffff;
+    }
+    return crc & 0xffff;
+}
@@ -99,6 +99,18 @@ static inline crc16_xmodem_t crc16_xmodem_init(void)
 crc16_xmodem_t crc16_xmodem_update(crc16_xmodem_t crc, const void *data, size_t data_len);
 
 
+/**
+ * Copy data and update the crc value with it, in the same pass.
+ *
+ * \param[in] crc      The current crc value.
+ * \param[out] dst     Pointer to the destination buffer of \a data_len bytes.
+ * \param[in] src      Pointer to the source buffer of \a data_len bytes.
+ * \param[in] data_len Number of bytes to copy.
+ * \return             The updated crc value.
+ */
+crc16_xmodem_t crc16_xmodem_copy_update(crc16_xmodem_t crc, void *dst, const void *src, size_t data_len);
+
+
 /**
  * Calculate the final crc value.
  *
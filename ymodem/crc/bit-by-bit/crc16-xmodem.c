@@ -54,6 +54,30 @@ crc16_xmodem_t crc16_xmodem_update(crc16_xmodem_t crc, const void *data, size_t
 }
 
 
+crc16_xmodem_t crc16_xmodem_copy_update(crc16_xmodem_t crc, void *dst, const void *src, size_t data_len)
+{
+    const unsigned char *s = (const unsigned char *)src;
+    unsigned char *d = (unsigned char *)dst;
+    unsigned int i;
+    bool bit;
+    unsigned char c;
+
+    while (data_len--) {
+        c = *s++;
+        *d++ = c;
+        for (i = 0; i < 8; i++) {
+            bit = crc & 0x8000;
+            crc = (crc << 1) | ((c >> (7 - i)) & 0x01);
+            if (bit) {
+                crc ^= 0x1021;
+            }
+        }
+        crc &= 0xffff;
+    }
+    return crc & 0xffff;
+}
+
+
 crc16_xmodem_t crc16_xmodem_finalize(crc16_xmodem_t crc)
 {
     unsigned int i;
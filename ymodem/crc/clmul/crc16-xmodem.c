@@ -0,0 +1,236 @@
+/**
+ * \file
+ * Functions and types for CRC checks.
+ *
+ * Carry-less multiplication folding: the message is processed 64 (then 16)
+ * bytes at a time with PCLMULQDQ, the 128 bit remainder and the tail are
+ * reduced with the table generated by pycrc v0.10.0 (https://pycrc.org).
+ * The implementation is chosen at the first call (CPUID): when PCLMULQDQ is not
+ * available, or on other architectures, the table-driven algorithm is used.
+ * Configuration:
+ *  - Width         = 16
+ *  - Poly          = 0x1021
+ *  - XorIn         = 0x0000
+ *  - ReflectIn     = False
+ *  - XorOut        = 0x0000
+ *  - ReflectOut    = False
+ *  - Algorithm     = clmul (carry-less multiply folding)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "crc16-xmodem.h"
+#include <stdlib.h>
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CRC_CLMUL_X86 1
+#include <immintrin.h>
+#endif
+
+
+/**
+ * Static table used for the table_driven implementation.
+ */
+static const crc16_xmodem_t crc_table[256] = {
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50a5, 0x60c6, 0x70e7,
+    0x8108, 0x9129, 0xa14a, 0xb16b, 0xc18c, 0xd1ad, 0xe1ce, 0xf1ef,
+    0x1231, 0x0210, 0x3273, 0x2252, 0x52b5, 0x4294, 0x72f7, 0x62d6,
+    0x9339, 0x8318, 0xb37b, 0xa35a, 0xd3bd, 0xc39c, 0xf3ff, 0xe3de,
+    0x2462, 0x3443, 0x0420, 0x1401, 0x64e6, 0x74c7, 0x44a4, 0x5485,
+    0xa56a, 0xb54b, 0x8528, 0x9509, 0xe5ee, 0xf5cf, 0xc5ac, 0xd58d,
+    0x3653, 0x2672, 0x1611, 0x0630, 0x76d7, 0x66f6, 0x5695, 0x46b4,
+    0xb75b, 0xa77a, 0x9719, 0x8738, 0xf7df, 0xe7fe, 0xd79d, 0xc7bc,
+    0x48c4, 0x58e5, 0x6886, 0x78a7, 0x0840, 0x1861, 0x2802, 0x3823,
+    0xc9cc, 0xd9ed, 0xe98e, 0xf9af, 0x8948, 0x9969, 0xa90a, 0xb92b,
+    0x5af5, 0x4ad4, 0x7ab7, 0x6a96, 0x1a71, 0x0a50, 0x3a33, 0x2a12,
+    0xdbfd, 0xcbdc, 0xfbbf, 0xeb9e, 0x9b79, 0x8b58, 0xbb3b, 0xab1a,
+    0x6ca6, 0x7c87, 0x4ce4, 0x5cc5, 0x2c22, 0x3c03, 0x0c60, 0x1c41,
+    0xedae, 0xfd8f, 0xcdec, 0xddcd, 0xad2a, 0xbd0b, 0x8d68, 0x9d49,
+    0x7e97, 0x6eb6, 0x5ed5, 0x4ef4, 0x3e13, 0x2e32, 0x1e51, 0x0e70,
+    0xff9f, 0xefbe, 0xdfdd, 0xcffc, 0xbf1b, 0xaf3a, 0x9f59, 0x8f78,
+    0x9188, 0x81a9, 0xb1ca, 0xa1eb, 0xd10c, 0xc12d, 0xf14e, 0xe16f,
+    0x1080, 0x00a1, 0x30c2, 0x20e3, 0x5004, 0x4025, 0x7046, 0x6067,
+    0x83b9, 0x9398, 0xa3fb, 0xb3da, 0xc33d, 0xd31c, 0xe37f, 0xf35e,
+    0x02b1, 0x1290, 0x22f3, 0x32d2, 0x4235, 0x5214, 0x6277, 0x7256,
+    0xb5ea, 0xa5cb, 0x95a8, 0x8589, 0xf56e, 0xe54f, 0xd52c, 0xc50d,
+    0x34e2, 0x24c3, 0x14a0, 0x0481, 0x7466, 0x6447, 0x5424, 0x4405,
+    0xa7db, 0xb7fa, 0x8799, 0x97b8, 0xe75f, 0xf77e, 0xc71d, 0xd73c,
+    0x26d3, 0x36f2, 0x0691, 0x16b0, 0x6657, 0x7676, 0x4615, 0x5634,
+    0xd94c, 0xc96d, 0xf90e, 0xe92f, 0x99c8, 0x89e9, 0xb98a, 0xa9ab,
+    0x5844, 0x4865, 0x7806, 0x6827, 0x18c0, 0x08e1, 0x3882, 0x28a3,
+    0xcb7d, 0xdb5c, 0xeb3f, 0xfb1e, 0x8bf9, 0x9bd8, 0xabbb, 0xbb9a,
+    0x4a75, 0x5a54, 0x6a37, 0x7a16, 0x0af1, 0x1ad0, 0x2ab3, 0x3a92,
+    0xfd2e, 0xed0f, 0xdd6c, 0xcd4d, 0xbdaa, 0xad8b, 0x9de8, 0x8dc9,
+    0x7c26, 0x6c07, 0x5c64, 0x4c45, 0x3ca2, 0x2c83, 0x1ce0, 0x0cc1,
+    0xef1f, 0xff3e, 0xcf5d, 0xdf7c, 0xaf9b, 0xbfba, 0x8fd9, 0x9ff8,
+    0x6e17, 0x7e36, 0x4e55, 0x5e74, 0x2e93, 0x3eb2, 0x0ed1, 0x1ef0
+};
+
+
+/* dst can be NULL: in that case data is not copied (it is a constant once inlined) */
+__attribute__((always_inline))
+static inline crc16_xmodem_t crc16_xmodem_table(crc16_xmodem_t crc, unsigned char *dst, const unsigned char *d, size_t data_len)
+{
+    unsigned int tbl_idx;
+
+    while (data_len--) {
+        tbl_idx = ((crc >> 8) ^ *d) & 0xff;
+        crc = (crc_table[tbl_idx] ^ (crc << 8)) & 0xffff;
+        if (dst) {
+            *dst++ = *d;
+        }
+        d++;
+    }
+    return crc & 0xffff;
+}
+
+
+#ifdef CRC_CLMUL_X86
+
+/*
+ * A 16 bytes block is loaded as a 128 bit polynomial, first message bit as
+ * coefficient of x^127 (hence the byte swap). Folding the accumulator A over
+ * the next block B, n bits ahead, is
+ *   A * x^n + B = A_hi * x^(n+64) + A_lo * x^n + B
+ * where x^(n+64) and x^n are replaced by their (16 bit) remainders mod P:
+ * the result is congruent and still fits in 128 bits.
+ */
+#define K_128   0xaefc  /* x^128 mod P */
+#define K_192   0x650b  /* x^192 mod P */
+#define K_512   0x13fc  /* x^512 mod P */
+#define K_576   0x8832  /* x^576 mod P */
+
+__attribute__((target("pclmul,ssse3")))
+static inline __m128i crc_fold(__m128i acc, __m128i k)
+{
+    return _mm_xor_si128(_mm_clmulepi64_si128(acc, k, 0x00), _mm_clmulepi64_si128(acc, k, 0x11));
+}
+
+/* load 16 bytes (copying them to dst, if any) as a 128 bit polynomial */
+__attribute__((target("pclmul,ssse3"), always_inline))
+static inline __m128i crc_load(unsigned char *dst, const unsigned char *d, size_t offset)
+{
+    const __m128i bswap = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    __m128i v = _mm_loadu_si128((const __m128i *)(d + offset));
+
+    if (dst) {
+        _mm_storeu_si128((__m128i *)(dst + offset), v);
+    }
+    return _mm_shuffle_epi8(v, bswap);
+}
+
+__attribute__((target("pclmul,ssse3"), always_inline))
+static inline crc16_xmodem_t crc16_xmodem_clmul(crc16_xmodem_t crc, unsigned char *dst, const unsigned char *d, size_t data_len)
+{
+    const __m128i bswap = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    const __m128i k1 = _mm_set_epi64x(K_192, K_128); /* fold by 16 bytes */
+    const __m128i k4 = _mm_set_epi64x(K_576, K_512); /* fold by 64 bytes */
+    __m128i acc;
+
+    if (data_len < 16) {
+        return crc16_xmodem_table(crc, dst, d, data_len);
+    }
+
+    /* the current crc is merged into the first two message bytes */
+    acc = crc_load(dst, d, 0);
+    acc = _mm_xor_si128(acc, _mm_set_epi16((short)crc, 0, 0, 0, 0, 0, 0, 0));
+
+    if (data_len >= 64) {
+        /* 4 independent accumulators, 64 bytes per iteration */
+        __m128i acc1 = crc_load(dst, d, 16);
+        __m128i acc2 = crc_load(dst, d, 32);
+        __m128i acc3 = crc_load(dst, d, 48);
+        d += 64;
+        dst = dst ? dst + 64 : NULL;
+        data_len -= 64;
+        while (data_len >= 64) {
+            acc = _mm_xor_si128(crc_fold(acc, k4), crc_load(dst, d, 0));
+            acc1 = _mm_xor_si128(crc_fold(acc1, k4), crc_load(dst, d, 16));
+            acc2 = _mm_xor_si128(crc_fold(acc2, k4), crc_load(dst, d, 32));
+            acc3 = _mm_xor_si128(crc_fold(acc3, k4), crc_load(dst, d, 48));
+            d += 64;
+            dst = dst ? dst + 64 : NULL;
+            data_len -= 64;
+        }
+        /* merge the accumulators */
+        acc = _mm_xor_si128(crc_fold(acc, k1), acc1);
+        acc = _mm_xor_si128(crc_fold(acc, k1), acc2);
+        acc = _mm_xor_si128(crc_fold(acc, k1), acc3);
+    } else {
+        d += 16;
+        dst = dst ? dst + 16 : NULL;
+        data_len -= 16;
+    }
+
+    /* 16 bytes per iteration */
+    while (data_len >= 16) {
+        acc = _mm_xor_si128(crc_fold(acc, k1), crc_load(dst, d, 0));
+        d += 16;
+        dst = dst ? dst + 16 : NULL;
+        data_len -= 16;
+    }
+
+    /* reduce the 128 bit remainder, then the tail */
+    unsigned char rem[16];
+    _mm_storeu_si128((__m128i *)rem, _mm_shuffle_epi8(acc, bswap));
+    crc = crc16_xmodem_table(0, NULL, rem, sizeof(rem));
+    return crc16_xmodem_table(crc, dst, d, data_len);
+}
+
+__attribute__((target("pclmul,ssse3")))
+static crc16_xmodem_t crc16_xmodem_update_clmul(crc16_xmodem_t crc, const unsigned char *d, size_t data_len)
+{
+    return crc16_xmodem_clmul(crc, NULL, d, data_len);
+}
+
+__attribute__((target("pclmul,ssse3")))
+static crc16_xmodem_t crc16_xmodem_copy_update_clmul(crc16_xmodem_t crc, unsigned char *dst, const unsigned char *d, size_t data_len)
+{
+    return crc16_xmodem_clmul(crc, dst, d, data_len);
+}
+
+/* true if the cpu supports the instructions we need, checked at the first call */
+static int crc_has_clmul(void)
+{
+    static int hasClmul = -1;
+
+    if (hasClmul < 0) {
+        __builtin_cpu_init();
+        hasClmul = __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("ssse3");
+    }
+    return hasClmul;
+}
+
+#endif /* CRC_CLMUL_X86 */
+
+
+crc16_xmodem_t crc16_xmodem_update(crc16_xmodem_t crc, const void *data, size_t data_len)
+{
+#ifdef CRC_CLMUL_X86
+    if (crc_has_clmul()) {
+        return crc16_xmodem_update_clmul(crc, (const unsigned char *)data, data_len);
+    }
+#endif
+    return crc16_xmodem_table(crc, NULL, (const unsigned char *)data, data_len);
+}
+
+
+crc16_xmodem_t crc16_xmodem_copy_update(crc16_xmodem_t crc, void *dst, const void *src, size_t data_len)
+{
+#ifdef CRC_CLMUL_X86
+    if (crc_has_clmul()) {
+        return crc16_xmodem_copy_update_clmul(crc, (unsigned char *)dst, (const unsigned char *)src, data_len);
+    }
+#endif
+    return crc16_xmodem_table(crc, (unsigned char *)dst, (const unsigned char *)src, data_len);
+}
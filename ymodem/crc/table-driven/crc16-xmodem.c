@@ -82,3 +82,18 @@ crc16_xmodem_t crc16_xmodem_update(crc16_xmodem_t crc, const void *data, size_t
     }
     return crc & 0xffff;
 }
+
+
+crc16_xmodem_t crc16_xmodem_copy_update(crc16_xmodem_t crc, void *dst, const void *src, size_t data_len)
+{
+    const unsigned char *s = (const unsigned char *)src;
+    unsigned char *d = (unsigned char *)dst;
+    unsigned int tbl_idx;
+
+    while (data_len--) {
+        tbl_idx = ((crc >> 8) ^ *s) & 0xff;
+        crc = (crc_table[tbl_idx] ^ (crc << 8)) & 0xffff;
+        *d++ = *s++;
+    }
+    return crc & 0xffff;
+}
@@ -30,3 +30,12 @@ int ymodem_port_atoi (const char *nptr)
     return 0;
 }
 
+
+/*
+ * needed with YM_RX_PROFILE or YM_TRACE_LEVEL only: return a free running
+ * counter, eg. DWT->CYCCNT on Cortex-M or a timer counter register
+ */
+uint32_t ymodem_port_ticks(void)
+{
+    return 0;
+}
@@ -82,4 +82,56 @@ void *ymodem_port_memchr(const void *s, int c, size_t n) __attribute__((nonnull
 int ymodem_port_atoi(const char *nptr) __attribute__((nonnull (1)));
 
 
+/**
+ * @brief free running counter timing the receiver phases (YM_RX_PROFILE) and trace records (YM_TRACE_LEVEL)
+ *
+ * any unit will do, eg. a cycle counter (DWT->CYCCNT on Cortex-M) or a timer: the
+ * histograms are in its ticks. A phase longer than the counter wrap is seen shorter
+ */
+uint32_t ymodem_port_ticks(void);
+
+#if YM_PORT_BOUND
+/*
+ * with YM_PORT_BOUND the library calls these instead of the getBytes, putBytes, flush and
+ * processData callbacks of the handle. They have to be static inline functions or macros,
+ * so that the compiler inlines them into the protocol engine; the prototypes are those of
+ * the callbacks (see ymodem.h), param is the one passed to ymodem_init() or ymodem_tx_init()
+ */
+
+/**
+ * @brief receive up to len bytes within tout ms
+ *
+ * return as soon as at least one byte is available: the number of bytes stored into buf,
+ * 0 on timeout or -1 on error (eg. UART read with a timeout)
+ */
+static inline int32_t ymodem_port_getBytes(void *param, uint8_t *buf, size_t len, uint32_t tout)
+{
+    return 0;
+}
+
+/**
+ * @brief output len bytes, they may stay buffered until ymodem_port_flush()
+ */
+static inline void ymodem_port_putBytes(void *param, const uint8_t *buf, size_t len)
+{
+}
+
+/**
+ * @brief send out the bytes buffered so far, called before waiting for the other side
+ */
+static inline void ymodem_port_flush(void *param)
+{
+}
+
+/**
+ * @brief store a data block of the file being received
+ *
+ * return 0 on success, anything else ends the session (eg. flash write)
+ */
+static inline int32_t ymodem_port_processData(void *param, const uint8_t *buffer, size_t buffSz)
+{
+    return 0;
+}
+#endif
+
 #endif /* YMODEM_PORT_H */
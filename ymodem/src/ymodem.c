@@ -13,13 +13,13 @@
  * limitations under the License.
  */
 #include "ymodem.h"
+#include "ymodem_trace.h"
 #include <stdint.h>
 #include <stddef.h>
 #include <string.h>
 #include <ctype.h>
 #include "crc16-xmodem.h"
 #include "ymodem_port.h"
-#include <sys/types.h> /* for ssize_t */
 
 #define PACKET_SEQNO_INDEX      (1)
 #define PACKET_SEQNO_COMP_INDEX (2)
@@ -29,6 +29,23 @@
 #define PACKET_OVERHEAD         (PACKET_HEADER + PACKET_TRAILER)
 #define PACKET_SIZE             (128)
 #define PACKET_1K_SIZE          (1024)
+#define PACKET_1K_SHIFT         (10)
+
+/* bytes dropped at most by a purge without the time limit (YM_RX_MIN_RAM): the largest frame */
+#define PURGE_MAX_BYTES         (PACKET_OVERHEAD + YM_MAX_BLOCK_SIZE)
+
+_Static_assert((YM_MAX_BLOCK_SIZE >= PACKET_1K_SIZE) && (YM_MAX_BLOCK_SIZE <= 32768) &&
+               (0 == (YM_MAX_BLOCK_SIZE & (YM_MAX_BLOCK_SIZE - 1))), "YM_MAX_BLOCK_SIZE must be a power of two in [1024, 32768]");
+#define YM_MAX_BLOCK_SHIFT      (__builtin_ctz(YM_MAX_BLOCK_SIZE))
+
+_Static_assert((YM_WINDOW_MAX >= 1) && (YM_WINDOW_MAX <= 32) && (0 == (YM_WINDOW_MAX & (YM_WINDOW_MAX - 1))),
+               "YM_WINDOW_MAX must be a power of two in [1, 32]");
+
+_Static_assert(!((YM_RX_ZERO_COPY) || (YM_RX_MIN_RAM)) || (1 == YM_WINDOW_MAX), "a window needs the receiver block buffers");
+_Static_assert(!((YM_RX_MIN_RAM) && (YM_RX_ASYNC_COMMIT)), "YM_RX_MIN_RAM has no block buffer to commit asynchronously");
+
+/* extensions (extended blocks, window) negotiated in block 0 */
+#define YM_EXT_ENABLED          ((YM_MAX_BLOCK_SIZE > PACKET_1K_SIZE) || (YM_WINDOW_MAX > 1))
 
 /* length of the file size field in the block 0 */
 #ifndef YM_FILE_SIZE_LENGTH
@@ -42,12 +59,23 @@
 #define NAK                     (0x15)  /* negative acknowledge */
 #define CAN                     (0x18)  /* two of these in succession aborts transfer */
 #define CRC16                   (0x43)  /* 'C' == 0x43, request 16-bit CRC */
+#define CRC16_G                 (0x47)  /* 'G' == 0x47, request 16-bit CRC and streaming (YMODEM-g) */
+#define CPMEOF                  (0x1A)  /* padding of the last data block */
 
+/*
+ * extensions: the sender appends to block 0, right after the file info string, EXT_MAGIC,
+ * the log2 of the largest block it can send and the largest window it can keep in flight.
+ * If the receiver supports them, after ACKing block 0 it replies EXT_ACCEPT, the log2 of
+ * the block size and the window to use (the smaller values), then 'C' (or 'G') as usual.
+ * Data blocks bigger than 1024 bytes start with XTX. With a window greater than 1 every
+ * ACK/NAK (EOT's one too) is followed by the number of the block it refers to and its
+ * complement, like in the block header: a number hit by a line error is not taken for another
+ */
+#define XTX                     (0x03)  /* start of extended size data packet */
+#define EXT_ACCEPT              (0x58)  /* 'X' == 0x58, extensions accepted */
+#define EXT_MAGIC               "YAYX"
 
 
-#define PKT_TIMEOUT_ms          (10000)
-#define CHAR_TIMEOUT_ms         (1000)
-#define MAX_RETRY               (5)
 
 #define min(a, b)                                                                                                     \
     ({                                                                                                                 \
@@ -56,6 +84,13 @@
         _a < _b ? _a : _b;                                                                                             \
     })
 
+#define max(a, b)                                                                                                     \
+    ({                                                                                                                 \
+        typeof(a) _a = (a);                                                                                            \
+        typeof(b) _b = (b);                                                                                            \
+        _a > _b ? _a : _b;                                                                                             \
+    })
+
 typedef enum
 {
     pktTYPE_timeout = -2,
@@ -67,128 +102,208 @@ typedef enum
     pktTYPE_CAN,
 }pktTYPE_t;
 
+/* where the packet parser is within a packet */
+typedef enum
+{
+    pktSTATE_start, /* waiting first char */
+    pktSTATE_CAN, /* first CAN received, waiting the second one */
+    pktSTATE_header, /* receiving block number and its complement */
+    pktSTATE_data, /* receiving data bytes */
+    pktSTATE_crc, /* receiving crc */
+    pktSTATE_purge, /* broken packet, dropping bytes until the line gets quiet */
+}pktSTATE_t;
 
-struct ymodem_desc
+/* where the receiver is within the batch */
+typedef enum
 {
-    uint8_t data[PACKET_1K_SIZE]; /* buffer for blocks */
-    char filename[YM_FILE_NAME_LENGTH]; /* buffer for filenames */
-    ssize_t filesize; /* filesize */
-    ssize_t bytesRecved; /* file bytes received */
+    rxSTATE_block0, /* 'C' sent, waiting block 0 of next file */
+    rxSTATE_data, /* receiving data blocks of a file */
+    rxSTATE_done, /* session terminated, result in status */
+}rxSTATE_t;
 
-    void *cbParam; /* parameter to pass to the callbacks */
 
-    /* callbacks */
-    ymodem_maxFileSize_t maxFileSize;
-    ymodem_receiveStart_t receiveStart;
-    ymodem_processData_t processData;
-    ymodem_receiveEnd_t receiveEnd;
-    ymodem_getByte_t getByte;
-    ymodem_putByte_t putByte;
-};
+static const ymodem_timing_t defaultTiming = YM_TIMING_DEFAULT;
 
-_Static_assert(sizeof(struct ymodem_desc) == sizeof(staticYmodem_t), "sizes of public and private structures must match");
+/* a field of the private structures */
+#define YM_FIELD(type, name, dim) type name dim;
 
-static pktTYPE_t ymodem_receive_packet(ymodem_desc_t *ymHdl, size_t *pktLen, u_int8_t *seqNum)
+struct ymodem_desc
 {
-    int c;
+    YM_RX_FIELDS(YM_FIELD)
+};
 
-    /* wait first char */
-    c = ymHdl->getByte(ymHdl->cbParam, PKT_TIMEOUT_ms);
-    switch(c)
-    {
-    case -1: /* timeout or error */
-        ymodem_log("timeout\n");
-        return pktTYPE_timeout;
-    case CAN:
-        c = ymHdl->getByte(ymHdl->cbParam, CHAR_TIMEOUT_ms);
-        if (CAN == c)
-        {
-            ymodem_log("Abort trom other\n");
-            return pktTYPE_CAN;
-        }
-        return pktTYPE_brokenPkt;
-    case SOH:
-        *pktLen = PACKET_SIZE;
-        break;
-    case STX:
-        *pktLen = PACKET_1K_SIZE;
-        break;
-    case EOT:
-        ymodem_log("EOT\n");
-        return pktTYPE_EOT;
-    case ACK:
-        ymodem_log("ACK\n");
-        return pktTYPE_ACK;
-    case NAK:
-        ymodem_log("NAK\n");
-        return pktTYPE_NAK;
-    }
-
-    /* get block number and its complement */
-    uint8_t blk_n, blk_n_compl;
-    c = ymHdl->getByte(ymHdl->cbParam, CHAR_TIMEOUT_ms);
-    if(c < 0)
+/* the field list in ymodem.h can't see the protocol constants */
+_Static_assert((sizeof(((struct ymodem_desc *)0)->hdr) == PACKET_HEADER - 1) && (sizeof(((struct ymodem_desc *)0)->trl) == PACKET_TRAILER) &&
+               (sizeof(((struct ymodem_desc *)0)->crc) == sizeof(crc16_xmodem_t)), "receiver fields sized for another packet format");
+
+/* counters of ymodem_get_stats(), nothing is left of them without YM_RX_STATS */
+#if YM_RX_STATS
+#define YM_STAT_ADD(ymHdl, counter, n)  ((ymHdl)->stats.counter += (n))
+#else
+#define YM_STAT_ADD(ymHdl, counter, n)  do {} while(0)
+#endif
+
+#if YM_RX_PROFILE
+/* count a phase lasting ticks into its log2 histogram, only data blocks are profiled */
+static void ymodem_prof_add(ymodem_desc_t *ymHdl, ymodem_phase_t phase, uint32_t ticks)
+{
+    if(rxSTATE_data != ymHdl->rxState)
     {
-        ymodem_log("broken 1\n");
-        return pktTYPE_brokenPkt;
+        return;
     }
-    blk_n = c & 0xff;
-    c = ymHdl->getByte(ymHdl->cbParam, CHAR_TIMEOUT_ms);
-    if(c < 0)
+    size_t bin = (0 == ticks) ? 0 : 8 * sizeof(unsigned long) - __builtin_clzl(ticks); /* significant bits */
+    ymHdl->prof.hist[phase][min(bin, (size_t)(YM_PROF_BINS - 1))]++;
+}
+
+/* the first byte of a packet has arrived: the wait is over */
+static void ymodem_prof_packet(ymodem_desc_t *ymHdl)
+{
+    ymHdl->profPkt = ymodem_port_ticks();
+    ymodem_prof_add(ymHdl, ymPhase_wait, ymHdl->profPkt - ymHdl->profWait);
+    ymHdl->profCrc = 0;
+}
+
+/* timing hooks: a mark is taken when a phase starts, the ticks elapsed are counted when it ends */
+#define YM_PROF_MARK(mark)              ((mark) = ymodem_port_ticks())
+#define YM_PROF_END(ymHdl, phase, mark) ymodem_prof_add((ymHdl), (phase), ymodem_port_ticks() - (mark))
+#define YM_PROF_ADD(ymHdl, phase, t)    ymodem_prof_add((ymHdl), (phase), (t))
+#define YM_PROF_PACKET(ymHdl)           ymodem_prof_packet(ymHdl)
+#define YM_PROF_TIME(ymHdl, phase, expr) \
+    ({ uint32_t _t0 = ymodem_port_ticks(); typeof(expr) _r = (expr); ymodem_prof_add((ymHdl), (phase), ymodem_port_ticks() - _t0); _r; })
+#define YM_PROF_CRC(ymHdl, expr) \
+    do { uint32_t _t0 = ymodem_port_ticks(); (expr); (ymHdl)->profCrc += ymodem_port_ticks() - _t0; } while(0)
+#else
+#define YM_PROF_MARK(mark)              do {} while(0)
+#define YM_PROF_END(ymHdl, phase, mark) do {} while(0)
+#define YM_PROF_ADD(ymHdl, phase, t)    do {} while(0)
+#define YM_PROF_PACKET(ymHdl)           do {} while(0)
+#define YM_PROF_TIME(ymHdl, phase, expr) (expr)
+#define YM_PROF_CRC(ymHdl, expr)        (expr)
+#endif
+
+#if YM_TRACE_LEVEL > 0
+static ymodem_trace_ring_t traceRing = { .magic = YM_TRACE_MAGIC, .records = YM_TRACE_RECORDS };
+
+_Static_assert(0 == (YM_TRACE_RECORDS & (YM_TRACE_RECORDS - 1)), "YM_TRACE_RECORDS must be a power of two");
+
+void ymodem_trace(uint8_t event, uint8_t blkNum, uint16_t arg)
+{
+    uint32_t idx = __atomic_fetch_add(&traceRing.head, 1, __ATOMIC_RELAXED);
+    ymodem_trace_rec_t *rec = &traceRing.rec[idx & (YM_TRACE_RECORDS - 1)];
+
+    rec->ticks = ymodem_port_ticks();
+    rec->arg = arg;
+    rec->event = event;
+    rec->blkNum = blkNum;
+}
+
+const ymodem_trace_ring_t *ymodem_trace_ring(void)
+{
+    return &traceRing;
+}
+
+void ymodem_trace_clear(void)
+{
+    __atomic_store_n(&traceRing.head, 0, __ATOMIC_RELAXED);
+}
+#endif
+
+/* trace hooks by level, what is above YM_TRACE_LEVEL leaves no code */
+#if YM_TRACE_LEVEL >= YM_TRACE_ERROR
+#define YM_TR_ERROR(event, blkNum, arg) ymodem_trace((event), (blkNum), (arg))
+#else
+#define YM_TR_ERROR(event, blkNum, arg) do {} while(0)
+#endif
+#if YM_TRACE_LEVEL >= YM_TRACE_INFO
+#define YM_TR_INFO(event, blkNum, arg)  ymodem_trace((event), (blkNum), (arg))
+#else
+#define YM_TR_INFO(event, blkNum, arg)  do {} while(0)
+#endif
+#if YM_TRACE_LEVEL >= YM_TRACE_DEBUG
+#define YM_TR_DEBUG(event, blkNum, arg) ymodem_trace((event), (blkNum), (arg))
+#else
+#define YM_TR_DEBUG(event, blkNum, arg) do {} while(0)
+#endif
+
+/* output len bytes, using bulk callback when available */
+static void ymodem_put_bytes(const ymodem_io_t *io, void *cbParam, const uint8_t *buf, size_t len)
+{
+#if YM_PORT_BOUND
+    ymodem_port_putBytes(cbParam, buf, len);
+#else
+    if(NULL != io->putBytes)
     {
-        ymodem_log("broken 2\n");
-        return pktTYPE_brokenPkt;
+        io->putBytes(cbParam, buf, len);
+        return;
     }
-    blk_n_compl = c & 0xff;
-    /* get data bytes and compute crc */
-    crc16_xmodem_t computedCrc;
-    computedCrc = crc16_xmodem_init();
-    for(int i=0;i<*pktLen;i++)
+    for(size_t i=0;i<len;i++)
     {
-        c = ymHdl->getByte(ymHdl->cbParam, CHAR_TIMEOUT_ms);
-        if(c < 0)
-        {
-            ymodem_log("broken 3\n");
-            return pktTYPE_brokenPkt;
-        }
-        ymHdl->data[i] = (uint8_t)c;
-        computedCrc = crc16_xmodem_update(computedCrc, &ymHdl->data[i], 1);
+        io->putByte(cbParam, buf[i]);
     }
-    computedCrc = crc16_xmodem_finalize(computedCrc);
+#endif
+}
 
-    /* get crc */
-    uint16_t crc;
-    c = ymHdl->getByte(ymHdl->cbParam, CHAR_TIMEOUT_ms);
-    if(c < 0)
-    {
-        ymodem_log("broken 4\n");
-        return pktTYPE_brokenPkt;
-    }
-    crc = ((uint8_t)c)<<8;
-    c = ymHdl->getByte(ymHdl->cbParam, CHAR_TIMEOUT_ms);
-    if(c < 0)
+static void ymodem_flush(const ymodem_io_t *io, void *cbParam)
+{
+#if YM_PORT_BOUND
+    ymodem_port_flush(cbParam);
+#else
+    if(NULL != io->flush)
     {
-        ymodem_log("broken 5\n");
-        return pktTYPE_brokenPkt;
+        io->flush(cbParam);
     }
-    crc |= ((uint8_t)c)<<0;
+#endif
+}
 
-    /* check block number with its complement */
-    if( blk_n != (uint8_t)(~blk_n_compl))
+/* read up to len bytes whithin tout; return number of bytes read, 0 on timeout, negative on error */
+static int32_t ymodem_read(const ymodem_io_t *io, void *cbParam, uint8_t *buf, size_t len, uint32_t tout)
+{
+#if YM_PORT_BOUND
+    return ymodem_port_getBytes(cbParam, buf, len, tout);
+#else
+    if(NULL != io->getBytes) /* bulk reads, as many bytes as the transport has ready */
     {
-        ymodem_log("block number\n");
-        return pktTYPE_brokenPkt;
+        return io->getBytes(cbParam, buf, len, tout);
     }
-    *seqNum = blk_n;
 
-    /* chaeck crc */
-    if( crc != computedCrc)
+    /* fallback: one call per byte */
+    int c = io->getByte(cbParam, tout);
+    if(c < 0)
     {
-        ymodem_log("crc\n");
-        return pktTYPE_brokenPkt;
+        return (-1 == c) ? 0 : c;
     }
-    ymodem_log("data (blk n. %hhu)\n", blk_n);
-    return pktTYPE_data;
+    buf[0] = (uint8_t)c;
+    return 1;
+#endif
+}
+
+/* queue a single control char, it will be sent by next flush */
+static void ymodem_put_ctrl(ymodem_desc_t *ymHdl, uint8_t c)
+{
+    ymodem_put_bytes(&ymHdl->io, ymHdl->cbParam, &c, 1);
+}
+
+/* queue the last char of a reply and flush, we are going to wait for the sender */
+static void ymodem_end_ctrl(ymodem_desc_t *ymHdl, uint8_t c)
+{
+    ymodem_put_ctrl(ymHdl, c);
+    ymodem_flush(&ymHdl->io, ymHdl->cbParam);
+}
+
+/* send a single control char (C, ACK, NAK) and flush */
+static void ymodem_send_ctrl(ymodem_desc_t *ymHdl, uint8_t c)
+{
+    YM_TR_DEBUG(ymTrace_reply, ymHdl->expectedPacket, c);
+    ymodem_end_ctrl(ymHdl, c);
+}
+
+/* ask the other side to abort the transfer */
+static void ymodem_send_abort(const ymodem_io_t *io, void *cbParam)
+{
+    static const uint8_t abortSeq[] = {CAN, CAN};
+
+    ymodem_put_bytes(io, cbParam, abortSeq, sizeof(abortSeq));
+    ymodem_flush(io, cbParam);
 }
 
 typedef enum
@@ -198,15 +313,19 @@ typedef enum
     blk0TYPE_Empty,
 }blk0TYPE_t;
 
-static blk0TYPE_t ymodem_parse_block0(const uint8_t *data, size_t pktLen, char *filename, ssize_t *filesize)
+static blk0TYPE_t ymodem_parse_block0(const uint8_t *data, size_t pktLen, char *filename, ptrdiff_t *filesize)
 {
     if(0 == data[0]) /* a null pathname should terminate trasmission */
     {
         return blk0TYPE_Empty;
     }
-    char *dstPtr  = ymodem_port_stpncpy(filename, (const char *)data, YM_FILE_NAME_LENGTH);
-    filename[YM_FILE_NAME_LENGTH-1] = 0; /* null termination, just in case */
-    int idx = dstPtr -filename;
+    int idx = 0;
+    if(NULL != filename) /* otherwise it is used in place */
+    {
+        char *dstPtr  = ymodem_port_stpncpy(filename, (const char *)data, YM_FILE_NAME_LENGTH-1);
+        filename[YM_FILE_NAME_LENGTH-1] = 0; /* a longer name is truncated */
+        idx = dstPtr -filename;
+    }
     uint8_t *fileSzPtr = ymodem_port_memchr(&data[idx], 0, pktLen-idx); /* at the moment fileSzPtr actually point to null termination char of the filename */
     if(NULL == fileSzPtr) /* it seems that filename is endless */
     {
@@ -226,204 +345,2043 @@ static blk0TYPE_t ymodem_parse_block0(const uint8_t *data, size_t pktLen, char *
     return blk0TYPE_OK;
 }
 
-typedef enum
+#if YM_EXT_ENABLED
+/* look for the extensions after the file info: 0 if found (shift and window are limited to what the sender can do), -1 otherwise */
+static int ymodem_parse_block0_ext(const uint8_t *data, size_t pktLen, uint8_t *shift, uint8_t *window)
 {
-    fileRecv_Error = -1, /* this include timeout, crc errors, unknown characters, etc. */
-    fileRecv_OK,
-    fileRecv_EOT,
-    fileRecv_Abort,
-}fileRecv_t;
+    const uint8_t *ptr = ymodem_port_memchr(data, 0, pktLen); /* end of filename */
+    if(NULL == ptr)
+    {
+        return -1;
+    }
+    ptr++;
+    ptr = ymodem_port_memchr(ptr, 0, pktLen - (ptr - data)); /* end of file info */
+    if((NULL == ptr) || ((size_t)(ptr + sizeof(EXT_MAGIC) + 1 - data) >= pktLen))
+    {
+        return -1;
+    }
+    ptr++;
+    if(0 != memcmp(ptr, EXT_MAGIC, sizeof(EXT_MAGIC) - 1))
+    {
+        return -1;
+    }
+    ptr += sizeof(EXT_MAGIC) - 1;
+    *shift = min(*shift, ptr[0]);
+    if(*shift < PACKET_1K_SHIFT)
+    {
+        *shift = PACKET_1K_SHIFT;
+    }
+    *window = min(*window, ptr[1]);
+    if(0 == *window)
+    {
+        *window = 1;
+    }
+    return 0;
+}
+#endif
 
-static fileRecv_t ymodem_receive_file(ymodem_desc_t *ymHdl)
+/* true if time a is at or after time b (wrap around safe) */
+static inline int ymodem_time_reached(uint32_t a, uint32_t b)
 {
-    pktTYPE_t pktType;
-    uint8_t blkNum;
-    size_t pktLen;
-    int retryCount = 0;
-    size_t maxFileSize;
+    return (int32_t)(a - b) >= 0;
+}
 
-    /* request to start transmission */
-    ymHdl->putByte(ymHdl->cbParam, CRC16);
+/* timing of the receiver: fixed at build time in the minimal RAM profile, set by ymodem_set_timing() otherwise */
+static inline uint32_t ymodem_rx_pkt_timeout(const ymodem_desc_t *ymHdl)
+{
+#if YM_RX_MIN_RAM
+    return YM_PKT_TIMEOUT_MS;
+#else
+    return ymHdl->pktTimeout;
+#endif
+}
 
-    retryCount = 0;
-    do
-    {
-        /* wait packet */
-        pktType = ymodem_receive_packet(ymHdl, &pktLen, &blkNum);
-        /* check packet */
-        switch (pktType)
-        {
-        case pktTYPE_timeout: /* when timeout we have to resend 'C' */
-            ymHdl->putByte(ymHdl->cbParam, CRC16);
-            continue;
-        case pktTYPE_brokenPkt:
-        case pktTYPE_EOT:
-        case pktTYPE_ACK:
-        case pktTYPE_NAK: /* for unexpected char or broken packet we send NAK */
-            ymHdl->putByte(ymHdl->cbParam, NAK);
-            continue;
-        case pktTYPE_CAN: /* If sender ask to stop transer we ACK and exit */
-            ymHdl->putByte(ymHdl->cbParam, ACK);
-            return fileRecv_Abort;
-        case pktTYPE_data:
-            break;
-        }
+static inline uint32_t ymodem_rx_char_timeout(const ymodem_desc_t *ymHdl)
+{
+#if YM_RX_MIN_RAM
+    return YM_CHAR_TIMEOUT_MS;
+#else
+    return ymHdl->charTimeout;
+#endif
+}
 
-        if(0 != blkNum) /* at this point we are waiting only packet 0 */
-        {
-            ymHdl->putByte(ymHdl->cbParam, NAK);
-            continue;
-        }
-        break; /* when we are here we are sure that packet is valideted */
-    }while(++retryCount < MAX_RETRY);
-    if(retryCount >= MAX_RETRY) /* we hav retryed enough, we give up asking sender to abort transfer */
+static inline uint32_t ymodem_rx_purge_gap(const ymodem_desc_t *ymHdl)
+{
+#if YM_RX_MIN_RAM
+    return YM_PURGE_GAP_MS;
+#else
+    return ymHdl->purgeGap;
+#endif
+}
+
+/* 0: waits for block 0 are counted as retries, always the case with the minimal RAM profile */
+static inline uint32_t ymodem_rx_start_timeout(const ymodem_desc_t *ymHdl)
+{
+#if YM_RX_MIN_RAM
+    return 0;
+#else
+    return ymHdl->startTimeout;
+#endif
+}
+
+/* length of the current wait for a packet */
+static inline uint32_t ymodem_rx_pkt_wait(const ymodem_desc_t *ymHdl)
+{
+#if YM_RX_MIN_RAM
+    return YM_PKT_TIMEOUT_MS;
+#else
+    return ymHdl->pktWait;
+#endif
+}
+
+static inline uint8_t ymodem_rx_max_retry(const ymodem_desc_t *ymHdl)
+{
+#if YM_RX_MIN_RAM
+    return YM_MAX_RETRY;
+#else
+    return ymHdl->maxRetry;
+#endif
+}
+
+#if !YM_RX_MIN_RAM
+static void ymodem_rtt_reset(ymodem_rtt_t *rtt)
+{
+    rtt->srtt = UINT32_MAX;
+    rtt->rttvar = 0;
+}
+
+/* add a sample (ms) to the estimate */
+static void ymodem_rtt_sample(ymodem_rtt_t *rtt, uint32_t sample, uint32_t ceiling)
+{
+    sample = min(sample, ceiling); /* no overflow, and a stall doesn't stick to the estimate */
+    if(UINT32_MAX == rtt->srtt)
     {
-        ymHdl->putByte(ymHdl->cbParam, CAN);
-        ymHdl->putByte(ymHdl->cbParam, CAN);
-        return fileRecv_Error;
+        rtt->srtt = sample << 3;
+        rtt->rttvar = sample << 1;
+        return;
     }
-    blk0TYPE_t blk0Type;
-
-    /* parse block 0 */
-    blk0Type = ymodem_parse_block0(ymHdl->data, pktLen, ymHdl->filename, &ymHdl->filesize);
-    ymHdl->bytesRecved = 0;
+    int32_t err = (int32_t)sample - (int32_t)(rtt->srtt >> 3);
+    rtt->srtt += err;
+    rtt->rttvar += (uint32_t)(err < 0 ? -err : err) - (rtt->rttvar >> 2);
+}
 
-    switch(blk0Type)
+/* wait derived from the estimate: srtt + 4 rttvar, doubled backoff times, from floor to ceiling */
+static uint32_t ymodem_rtt_timeout(const ymodem_rtt_t *rtt, uint8_t backoff, uint32_t floor, uint32_t ceiling)
+{
+    if(UINT32_MAX == rtt->srtt)
     {
-    case blk0TYPE_Error: /* we give up */
-        ymHdl->putByte(ymHdl->cbParam, CAN);
-        ymHdl->putByte(ymHdl->cbParam, CAN);
-        return fileRecv_Error;
-    case blk0TYPE_OK:
-        ymHdl->putByte(ymHdl->cbParam, ACK);
-        break;
-    case blk0TYPE_Empty: /* empty block means end of transfer */
-        ymHdl->putByte(ymHdl->cbParam, ACK);
-        return fileRecv_EOT;
+        return ceiling;
+    }
+    uint32_t tout = max((rtt->srtt >> 3) + rtt->rttvar, floor);
+    if((backoff >= 32) || (tout > (ceiling >> backoff)))
+    {
+        return ceiling;
     }
+    return tout << backoff;
+}
+#endif
 
-    maxFileSize = ymHdl->maxFileSize(ymHdl->cbParam);
+/*
+ * true if the waits are derived from the measured times: only for stop and wait data blocks in YMODEM mode,
+ * there an expired wait means a lost block or reply. Block 0 waits for the user to start the sender, with a
+ * window or in YMODEM-g the sender doesn't wait for us
+ */
+static inline int ymodem_rx_adaptive(const ymodem_desc_t *ymHdl)
+{
+#if YM_RX_MIN_RAM
+    return 0; /* fixed waits */
+#else
+    return (0 != ymHdl->adaptive) && (rxSTATE_data == ymHdl->rxState) && (1 == ymHdl->window) && (ymMode_crc == ymHdl->mode);
+#endif
+}
 
-    if (ymHdl->filesize > maxFileSize) /* if the file if too long we give up */
+/* true, once, if the wait that expired was shorter than its ceiling: the failure is not counted */
+static inline int ymodem_rx_free_retry(ymodem_desc_t *ymHdl)
+{
+#if YM_RX_MIN_RAM
+    return 0;
+#else
+    int freeRetry = ymHdl->freeRetry;
+
+    ymHdl->freeRetry = 0;
+    return freeRetry;
+#endif
+}
+
+#if !YM_RX_MIN_RAM
+/* next wait for block 0: pollInterval after the first request (pktWait is 0), then twice the previous one, up to pktTimeout */
+static uint32_t ymodem_rx_poll_wait(ymodem_desc_t *ymHdl, uint32_t now_ms)
+{
+    uint32_t pktTimeout = ymodem_rx_pkt_timeout(ymHdl);
+    uint32_t wait = pktTimeout;
+
+    if(0 == ymHdl->pktWait) /* first request for the file */
     {
-        ymHdl->putByte(ymHdl->cbParam, CAN);
-        ymHdl->putByte(ymHdl->cbParam, CAN);
-        return fileRecv_Error;
+        ymHdl->startUntil = now_ms + ymHdl->startTimeout;
+        if(0 != ymHdl->pollInterval)
+        {
+            wait = min(ymHdl->pollInterval, pktTimeout);
+        }
     }
-    int32_t resStart;
-    resStart = ymHdl->receiveStart(ymHdl->cbParam, ymHdl->filename);
-    if (0 != resStart) /* error initialing transfer */
+    else if((0 != ymHdl->pollInterval) && (ymHdl->pktWait < (pktTimeout >> 1)))
     {
-        ymHdl->putByte(ymHdl->cbParam, CAN);
-        ymHdl->putByte(ymHdl->cbParam, CAN);
-        return fileRecv_Error;
+        wait = ymHdl->pktWait << 1;
     }
-    fileRecv_t ret = fileRecv_Error;
+    if((0 != ymHdl->startTimeout) && ymodem_time_reached(now_ms + wait, ymHdl->startUntil)) /* the last wait ends with the handshake */
+    {
+        wait = ymodem_time_reached(now_ms, ymHdl->startUntil) ? 0 : ymHdl->startUntil - now_ms;
+    }
+    return wait;
+}
+#endif
 
-    uint8_t expectedPacket = 1;
-    /* request to continue transmission */
-    ymHdl->putByte(ymHdl->cbParam, CRC16);
-    while(1)
+/* (re)start waiting for the first char of a packet */
+static void ymodem_rx_wait_packet(ymodem_desc_t *ymHdl, uint32_t now_ms)
+{
+    ymHdl->pktState = pktSTATE_start;
+    ymHdl->pktIdx = 0;
+    YM_PROF_MARK(ymHdl->profWait);
+#if YM_RX_MIN_RAM
+    ymHdl->deadline = now_ms + YM_PKT_TIMEOUT_MS;
+#else
+    if(rxSTATE_block0 == ymHdl->rxState)
     {
-        retryCount = 0;
-        do
-        {
-            /* wait packet */
-            pktType = ymodem_receive_packet(ymHdl, &pktLen, &blkNum);
-            /* check packet */
-            switch (pktType)
-            {
-            case pktTYPE_timeout:
-            case pktTYPE_brokenPkt:
-            case pktTYPE_ACK:
-            case pktTYPE_NAK: /* for timeout or unexpected char or broken packet we send NAK */
-                ymodem_log("send NAK due to pkType %d\n", pktType);
-                ymHdl->putByte(ymHdl->cbParam, NAK);
-                continue;
-            case pktTYPE_EOT:
-                ymHdl->putByte(ymHdl->cbParam, ACK);
-                ret = fileRecv_OK;
-                goto ymodem_receive_file_end;
-            case pktTYPE_CAN: /* If sender ask to stop transer we ACK and exit */
-                ymHdl->putByte(ymHdl->cbParam, ACK);
-                ret = fileRecv_Abort;
-                 goto ymodem_receive_file_end;
-           case pktTYPE_data:
-                break;
-            }
+        ymHdl->pktWait = ymodem_rx_poll_wait(ymHdl, now_ms);
+    }
+    else
+    {
+        ymHdl->pktWait = ymodem_rx_pkt_timeout(ymHdl);
+    }
+    ymHdl->rttArmed = 0;
+    ymHdl->freeRetry = 0;
+    if(ymodem_rx_adaptive(ymHdl))
+    {
+        ymHdl->pktWait = ymodem_rtt_timeout(&ymHdl->rtt, ymHdl->backoff, ymHdl->minTimeout, ymHdl->pktTimeout);
+        ymHdl->rttArmed = (0 == ymHdl->backoff); /* after an expired wait we can't tell which reply the sender answers */
+        ymHdl->waitStart = now_ms;
+    }
+    ymHdl->deadline = now_ms + ymHdl->pktWait;
+#endif
+}
 
-            if(expectedPacket != blkNum) /* an out-of-sequence packet */
-            {
-                ymodem_log("out of sequence [exp %hhu, recv %hhu]\n", expectedPacket, blkNum);
-                ymHdl->putByte(ymHdl->cbParam, NAK);
-                continue;
-            }
-            break; /* when we are here we are sure that packet is valideted */
-        }while(++retryCount < MAX_RETRY);
+/* bytes have arrived: sample the times, return how long to wait for the next bytes of the packet */
+static uint32_t ymodem_rx_arrival(ymodem_desc_t *ymHdl, uint32_t now_ms)
+{
+#if YM_RX_MIN_RAM
+    return YM_CHAR_TIMEOUT_MS;
+#else
+    if(!ymodem_rx_adaptive(ymHdl))
+    {
+        return ymHdl->charTimeout;
+    }
+    if(pktSTATE_start != ymHdl->pktState) /* more bytes of the same packet */
+    {
+        ymodem_rtt_sample(&ymHdl->gap, now_ms - ymHdl->lastByteAt, ymHdl->charTimeout);
+    }
+    else if(0 != ymHdl->rttArmed) /* the sender answers our reply */
+    {
+        ymHdl->rttArmed = 0;
+        ymodem_rtt_sample(&ymHdl->rtt, now_ms - ymHdl->waitStart, ymHdl->pktTimeout);
+    }
+    ymHdl->lastByteAt = now_ms;
+    return ymodem_rtt_timeout(&ymHdl->gap, ymHdl->backoff, ymHdl->minTimeout, ymHdl->charTimeout);
+#endif
+}
 
-        if(retryCount >= MAX_RETRY)
-        {
-            ymHdl->putByte(ymHdl->cbParam, CAN);
-            ymHdl->putByte(ymHdl->cbParam, CAN);
-            ret = fileRecv_Error;
-            goto ymodem_receive_file_end;
-        }
+/* terminate the session */
+static void ymodem_rx_finish(ymodem_desc_t *ymHdl, ymodem_rxStatus_t status)
+{
+    YM_TR_INFO(ymTrace_sessionEnd, ymHdl->expectedPacket, (uint16_t)status);
+    ymHdl->rxState = rxSTATE_done;
+    ymHdl->status = status;
+}
 
-        size_t actualDataSz;
-        if(ymHdl->filesize < 0)
-        {
-            actualDataSz = pktLen;
-        }
-        else
-        {
-            actualDataSz = min(ymHdl->filesize - ymHdl->bytesRecved, pktLen);
-        }
+/* wait the commit in progress (if any), return its result */
+static int32_t ymodem_rx_commit_wait(ymodem_desc_t *ymHdl)
+{
+    if(0 == ymHdl->commitPending)
+    {
+        return 0;
+    }
+    ymHdl->commitPending = 0;
+    return ymHdl->commitWait(ymHdl->cbParam);
+}
 
-        int32_t resProcess;
-        resProcess = ymHdl->processData(ymHdl->cbParam, ymHdl->data, actualDataSz);
-        ymHdl->bytesRecved += actualDataSz;
-        if (0 != resProcess) /* error initialing transfer */
+/* give back to the user a block buffer (or the chunks passed so far) whose content is not valid */
+static void ymodem_rx_discard(ymodem_desc_t *ymHdl)
+{
+    if(0 != ymHdl->pktAcquired)
+    {
+        ymHdl->pktAcquired = 0;
+        ymHdl->releaseBlockBuffer(ymHdl->cbParam, 0);
+    }
+    if(0 != ymHdl->pktStreamed)
+    {
+        ymHdl->pktStreamed = 0;
+        if(ymHdl->pktBase > 0) /* some chunk has been passed already */
         {
-            ymHdl->putByte(ymHdl->cbParam, CAN);
-            ymHdl->putByte(ymHdl->cbParam, CAN);
-            ret = fileRecv_Error;
-            goto ymodem_receive_file_end;
+            ymHdl->rollback(ymHdl->cbParam, ymHdl->bytesRecved);
         }
-        ymHdl->putByte(ymHdl->cbParam, ACK);
-        expectedPacket++;
     }
-ymodem_receive_file_end:
+}
+
+/* the file is over (maybe not successfully): let storage finish its work */
+static void ymodem_rx_end_file(ymodem_desc_t *ymHdl)
+{
+    ymodem_rx_discard(ymHdl);
+    ymodem_rx_commit_wait(ymHdl);
     ymHdl->receiveEnd(ymHdl->cbParam);
-    return ret;
 }
 
-ymodem_desc_t *ymodem_init(staticYmodem_t *staticYmBuffer, void *cbParam, ymodem_maxFileSize_t maxFileSize, 
-                            ymodem_receiveStart_t receiveStart, ymodem_processData_t processData,
-                            ymodem_receiveEnd_t receiveEnd, ymodem_getByte_t getByte, ymodem_putByte_t putByte)
+/* pass data bytes to storage */
+static inline int32_t ymodem_rx_store(ymodem_desc_t *ymHdl, const uint8_t *data, size_t len)
 {
-    if(NULL == staticYmBuffer)
+#if YM_PORT_BOUND
+    return ymodem_port_processData(ymHdl->cbParam, data, len);
+#else
+    return ymHdl->processData(ymHdl->cbParam, data, len);
+#endif
+}
+
+/* we give up asking sender to abort transfer */
+static void ymodem_rx_abort(ymodem_desc_t *ymHdl)
+{
+    YM_TR_ERROR(ymTrace_abort, ymHdl->expectedPacket, ymHdl->retryCount);
+    if(rxSTATE_data == ymHdl->rxState)
     {
-        return NULL;
+        ymodem_rx_end_file(ymHdl);
     }
+    ymodem_send_abort(&ymHdl->io, ymHdl->cbParam);
+    ymodem_rx_finish(ymHdl, ymRxStatus_error);
+}
 
-    ymodem_desc_t *ymHdl = (ymodem_desc_t *)staticYmBuffer;
-    ymHdl->cbParam = cbParam;
-    ymHdl->maxFileSize = maxFileSize;
-    ymHdl->receiveStart = receiveStart;
-    ymHdl->processData = processData;
-    ymHdl->receiveEnd = receiveEnd;
-    ymHdl->getByte = getByte;
-    ymHdl->putByte = putByte;
-    return ymHdl;
+/* char asking the sender to start a file (and its data) */
+static inline uint8_t ymodem_rx_start_char(const ymodem_desc_t *ymHdl)
+{
+    return ymMode_g == ymHdl->mode ? CRC16_G : CRC16;
 }
 
-int ymodem_receive(ymodem_desc_t *ymHdl)
+/* a failure counted against maxRetry */
+static inline void ymodem_rx_count_retry(ymodem_desc_t *ymHdl)
 {
-    fileRecv_t fileRes;
-    do
+    YM_STAT_ADD(ymHdl, retries, 1);
+    if(rxSTATE_data == ymHdl->rxState)
     {
-        fileRes = ymodem_receive_file(ymHdl);
-    }while(fileRecv_OK == fileRes);
+        YM_STAT_ADD(ymHdl, fileRetries, 1);
+    }
+}
 
-    return fileRecv_EOT == fileRes ? 0: 1;
+/* count a failure, when we have retryed enough we give up */
+static void ymodem_rx_retry(ymodem_desc_t *ymHdl, uint8_t reply)
+{
+    if((ymMode_g == ymHdl->mode) && (NAK == reply)) /* YMODEM-g sender never retransmits: abort on the first error */
+    {
+        ymodem_log("error in streaming mode\n");
+        ymodem_rx_abort(ymHdl);
+        return;
+    }
+    if(!ymodem_rx_free_retry(ymHdl)) /* otherwise the wait was shorter than its ceiling: the next one is longer instead */
+    {
+        ymodem_rx_count_retry(ymHdl);
+        if(++ymHdl->retryCount >= ymodem_rx_max_retry(ymHdl))
+        {
+            ymodem_rx_abort(ymHdl);
+            return;
+        }
+    }
+    ymodem_send_ctrl(ymHdl, reply);
+}
+
+/* start a new file: request to start transmission */
+static void ymodem_rx_next_file(ymodem_desc_t *ymHdl)
+{
+    ymHdl->rxState = rxSTATE_block0;
+    ymHdl->retryCount = 0;
+    ymHdl->extShift = 0; /* extensions are negotiated file by file */
+    ymHdl->window = 1;
+    ymHdl->held = 0;
+    ymHdl->naked = 0;
+#if !YM_RX_MIN_RAM
+    ymHdl->pktWait = 0; /* the handshake starts */
+#endif
+    ymodem_send_ctrl(ymHdl, ymodem_rx_start_char(ymHdl));
+}
+
+/* handle a packet (or an event) while waiting block 0 */
+static void ymodem_rx_block0(ymodem_desc_t *ymHdl, pktTYPE_t pktType, uint8_t blkNum)
+{
+    /* check packet */
+    switch (pktType)
+    {
+    case pktTYPE_timeout: /* when timeout we have to resend 'C' (or 'G') */
+        if(0 == ymodem_rx_start_timeout(ymHdl))
+        {
+            ymodem_rx_retry(ymHdl, ymodem_rx_start_char(ymHdl));
+        }
+#if !YM_RX_MIN_RAM
+        else if(ymodem_time_reached(ymHdl->deadline, ymHdl->startUntil)) /* the sender never started */
+        {
+            ymodem_log("no sender\n");
+            YM_TR_ERROR(ymTrace_noSender, 0, 0);
+            ymodem_rx_abort(ymHdl);
+        }
+        else /* the sender may just be late: not a failure */
+        {
+            ymodem_send_ctrl(ymHdl, ymodem_rx_start_char(ymHdl));
+        }
+#endif
+        return;
+    case pktTYPE_brokenPkt:
+    case pktTYPE_EOT:
+    case pktTYPE_ACK:
+    case pktTYPE_NAK: /* for unexpected char or broken packet we send NAK */
+        ymodem_rx_retry(ymHdl, NAK);
+        return;
+    case pktTYPE_CAN: /* If sender ask to stop transer we ACK and exit */
+        ymodem_send_ctrl(ymHdl, ACK);
+        ymodem_rx_finish(ymHdl, ymRxStatus_error);
+        return;
+    case pktTYPE_data:
+        break;
+    }
+
+    if(0 != blkNum) /* at this point we are waiting only packet 0 */
+    {
+        YM_TR_ERROR(ymTrace_seqError, blkNum, 0);
+        YM_STAT_ADD(ymHdl, seqErrors, 1);
+        ymodem_rx_retry(ymHdl, NAK);
+        return;
+    }
+
+    blk0TYPE_t blk0Type;
+#if YM_RX_MIN_RAM
+    const char *filename = (const char *)ymHdl->pktDst; /* in place, receiveStart is the only one using it */
+    blk0Type = ymodem_parse_block0(ymHdl->pktDst, ymHdl->pktStore, NULL, &ymHdl->filesize);
+#else
+    const char *filename = ymHdl->filename;
+    blk0Type = ymodem_parse_block0(ymHdl->pktDst, ymHdl->pktStore, ymHdl->filename, &ymHdl->filesize);
+#endif
+    ymHdl->bytesRecved = 0;
+
+    switch(blk0Type)
+    {
+    case blk0TYPE_Error: /* we give up */
+        ymodem_rx_abort(ymHdl);
+        return;
+    case blk0TYPE_OK:
+        if(ymMode_crc == ymHdl->mode) /* YMODEM-g sender doesn't wait ACK for block 0 */
+        {
+            YM_TR_DEBUG(ymTrace_reply, 0, ACK);
+            ymodem_put_ctrl(ymHdl, ACK); /* flushed together with the request to continue */
+        }
+        break;
+    case blk0TYPE_Empty: /* empty block means end of transfer */
+        ymodem_send_ctrl(ymHdl, ACK);
+        ymodem_rx_finish(ymHdl, ymRxStatus_ok);
+        return;
+    }
+
+    size_t maxFileSize;
+    maxFileSize = ymHdl->maxFileSize(ymHdl->cbParam);
+
+    if (ymHdl->filesize > maxFileSize) /* if the file if too long we give up */
+    {
+        ymodem_rx_abort(ymHdl);
+        return;
+    }
+    int32_t resStart;
+    resStart = ymHdl->receiveStart(ymHdl->cbParam, filename);
+    if (0 != resStart) /* error initialing transfer */
+    {
+        ymodem_rx_abort(ymHdl);
+        return;
+    }
+
+    ymHdl->rxState = rxSTATE_data;
+    ymHdl->expectedPacket = 1;
+    ymHdl->retryCount = 0;
+#if YM_EXT_ENABLED
+    uint8_t shift = ymHdl->shiftMax;
+    uint8_t window = ymHdl->windowMax;
+    if((ymMode_g == ymHdl->mode) || (NULL != ymHdl->acquireBlockBuffer)) /* no ACKs at all in YMODEM-g, one block at a time into user buffers */
+    {
+        window = 1;
+    }
+    if((0 == ymodem_parse_block0_ext(ymHdl->pktDst, ymHdl->pktStore, &shift, &window)) &&
+       ((shift > PACKET_1K_SHIFT) || (window > 1)))
+    {
+        ymHdl->extShift = shift;
+        ymHdl->window = window;
+        ymodem_put_ctrl(ymHdl, EXT_ACCEPT);
+        ymodem_put_ctrl(ymHdl, shift);
+        ymodem_put_ctrl(ymHdl, window);
+    }
+#endif
+    /* request to continue transmission */
+    ymodem_send_ctrl(ymHdl, ymodem_rx_start_char(ymHdl));
+}
+
+/* block 0 again while waiting the first data block: our reply got lost, send it again (not a failure) */
+static void ymodem_rx_block0_again(ymodem_desc_t *ymHdl)
+{
+    ymodem_log("duplicate (blk n. 0)\n");
+    YM_TR_INFO(ymTrace_duplicate, 0, 0);
+    YM_STAT_ADD(ymHdl, duplicates, 1);
+    if(ymMode_crc == ymHdl->mode)
+    {
+        ymodem_put_ctrl(ymHdl, ACK);
+    }
+#if YM_EXT_ENABLED
+    if(0 != ymHdl->extShift) /* the extensions accepted, lost with the ACK */
+    {
+        ymodem_put_ctrl(ymHdl, EXT_ACCEPT);
+        ymodem_put_ctrl(ymHdl, ymHdl->extShift);
+        ymodem_put_ctrl(ymHdl, ymHdl->window);
+    }
+#endif
+    ymodem_send_ctrl(ymHdl, ymodem_rx_start_char(ymHdl));
+}
+
+/* bytes of the next pktLen bytes block belonging to the file, the others are padding */
+static size_t ymodem_rx_file_part(const ymodem_desc_t *ymHdl, size_t pktLen)
+{
+    if(ymHdl->filesize < 0)
+    {
+        return pktLen;
+    }
+    return min(ymHdl->filesize - ymHdl->bytesRecved, (ptrdiff_t)pktLen);
+}
+
+/* pass the data of a block to the user, 0 on success (on error the session is aborted) */
+static int ymodem_rx_deliver(ymodem_desc_t *ymHdl, const uint8_t *data, size_t pktLen)
+{
+    size_t actualDataSz = ymodem_rx_file_part(ymHdl, pktLen);
+
+    if(0 != ymodem_rx_commit_wait(ymHdl)) /* only one commit at a time, the previous one failed */
+    {
+        ymodem_rx_abort(ymHdl);
+        return -1;
+    }
+    YM_STAT_ADD(ymHdl, blocks, 1);
+
+    int32_t resProcess;
+    if(0 != ymHdl->pktAcquired) /* already in place */
+    {
+        ymHdl->pktAcquired = 0;
+        resProcess = ymHdl->releaseBlockBuffer(ymHdl->cbParam, 1);
+    }
+    else if(0 != ymHdl->pktStreamed) /* already passed in chunks, they are no more provisional */
+    {
+        ymHdl->pktStreamed = 0;
+        resProcess = 0;
+    }
+    else if(0 == actualDataSz) /* only padding: nothing to store */
+    {
+        return 0;
+    }
+    else
+    {
+        resProcess = ymodem_rx_store(ymHdl, data, actualDataSz);
+    }
+    ymHdl->bytesRecved += actualDataSz;
+    YM_STAT_ADD(ymHdl, bytes, actualDataSz);
+    if (0 != resProcess) /* error storing data */
+    {
+        ymodem_rx_abort(ymHdl);
+        return -1;
+    }
+    if(NULL != ymHdl->commitWait) /* the commit goes on while the next block is received */
+    {
+        ymHdl->commitPending = 1;
+        if((ymHdl->window > 1) && (0 != ymodem_rx_commit_wait(ymHdl))) /* the window reuses the slot sooner */
+        {
+            ymodem_rx_abort(ymHdl);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* handle a packet (or an event) while receiving file data */
+static void ymodem_rx_file_data(ymodem_desc_t *ymHdl, pktTYPE_t pktType, uint8_t blkNum)
+{
+    /* check packet */
+    switch (pktType)
+    {
+    case pktTYPE_timeout:
+    case pktTYPE_brokenPkt:
+    case pktTYPE_ACK:
+    case pktTYPE_NAK: /* for timeout or unexpected char or broken packet we send NAK */
+        ymodem_log("send NAK due to pkType %d\n", pktType);
+        ymodem_rx_retry(ymHdl, NAK);
+        return;
+    case pktTYPE_EOT:
+        if(0 != ymodem_rx_commit_wait(ymHdl)) /* the file is complete only when stored */
+        {
+            ymodem_rx_abort(ymHdl);
+            return;
+        }
+        ymodem_send_ctrl(ymHdl, ACK);
+        ymHdl->receiveEnd(ymHdl->cbParam);
+        ymodem_rx_next_file(ymHdl);
+        return;
+    case pktTYPE_CAN: /* If sender ask to stop transer we ACK and exit */
+        ymodem_send_ctrl(ymHdl, ACK);
+        ymodem_rx_end_file(ymHdl);
+        ymodem_rx_finish(ymHdl, ymRxStatus_error);
+        return;
+    case pktTYPE_data:
+        break;
+    }
+
+    if(ymHdl->expectedPacket != blkNum) /* an out-of-sequence packet */
+    {
+        if((0 == blkNum) && (0 == ymHdl->bytesRecved)) /* block 0, not block 256 */
+        {
+            ymodem_rx_block0_again(ymHdl);
+            return;
+        }
+        if(blkNum == (uint8_t)(ymHdl->expectedPacket - 1)) /* the previous one again: our ACK got lost */
+        {
+            ymodem_log("duplicate (blk n. %hhu)\n", blkNum);
+            YM_TR_INFO(ymTrace_duplicate, blkNum, 0);
+            YM_STAT_ADD(ymHdl, duplicates, 1);
+            ymodem_send_ctrl(ymHdl, ACK);
+            return;
+        }
+        ymodem_log("out of sequence [exp %hhu, recv %hhu]\n", ymHdl->expectedPacket, blkNum);
+        YM_TR_ERROR(ymTrace_seqError, blkNum, ymHdl->expectedPacket);
+        YM_STAT_ADD(ymHdl, seqErrors, 1);
+        ymodem_rx_retry(ymHdl, NAK);
+        return;
+    }
+
+    if(0 != YM_PROF_TIME(ymHdl, ymPhase_store, ymodem_rx_deliver(ymHdl, ymHdl->pktDst, ymHdl->pktLen)))
+    {
+        return;
+    }
+    if(ymMode_crc == ymHdl->mode) /* YMODEM-g: data blocks are not acknowledged */
+    {
+        ymodem_send_ctrl(ymHdl, ACK);
+    }
+    ymHdl->expectedPacket++;
+    ymHdl->retryCount = 0;
+}
+
+#if YM_WINDOW_MAX > 1
+/* ACK or NAK a block by number */
+static void ymodem_rx_reply(ymodem_desc_t *ymHdl, uint8_t c, uint8_t blkNum)
+{
+    YM_TR_DEBUG(ymTrace_reply, blkNum, c);
+    ymodem_put_ctrl(ymHdl, c);
+    ymodem_put_ctrl(ymHdl, blkNum);
+    ymodem_end_ctrl(ymHdl, ~blkNum);
+}
+
+/* NAK a block of the window not received yet, once until it arrives or the line gets quiet */
+static void ymodem_rx_nak_missing(ymodem_desc_t *ymHdl, uint8_t blkNum)
+{
+    uint32_t slotBit = 1u << (blkNum % YM_RX_BLOCKS);
+
+    if(0 != ((ymHdl->held | ymHdl->naked) & slotBit))
+    {
+        return;
+    }
+    ymHdl->naked |= slotBit;
+    ymodem_rx_reply(ymHdl, NAK, blkNum);
+}
+
+/* NAK the blocks missing before the last one received */
+static void ymodem_rx_nak_gaps(ymodem_desc_t *ymHdl, uint8_t last)
+{
+    for(uint8_t ofs=0;ofs<last;ofs++)
+    {
+        ymodem_rx_nak_missing(ymHdl, ymHdl->expectedPacket + ofs);
+    }
+}
+
+/* handle a packet (or an event) while receiving file data with a window */
+static void ymodem_rx_file_data_window(ymodem_desc_t *ymHdl, pktTYPE_t pktType, uint8_t blkNum)
+{
+    uint8_t ofs = blkNum - ymHdl->expectedPacket;
+    uint8_t slot = blkNum % YM_RX_BLOCKS;
+
+    switch (pktType)
+    {
+    case pktTYPE_ACK:
+    case pktTYPE_NAK: /* garbage */
+        return;
+    case pktTYPE_timeout: /* the line is quiet: ask again every block missing */
+    case pktTYPE_brokenPkt:
+        ymodem_rx_count_retry(ymHdl);
+        if(++ymHdl->retryCount >= min(ymodem_rx_max_retry(ymHdl) * ymHdl->window, UINT8_MAX))
+        {
+            ymodem_rx_abort(ymHdl);
+            return;
+        }
+        if(pktTYPE_timeout == pktType)
+        {
+            ymHdl->naked = 0;
+        }
+        else if((ymHdl->pktState >= pktSTATE_data) && (ofs < ymHdl->window)) /* the header was good: we know which one is damaged */
+        {
+            ymHdl->naked &= ~(1u << slot); /* it may be the block NAKed before, damaged again */
+            ymodem_rx_nak_missing(ymHdl, blkNum);
+        }
+        ymodem_rx_nak_missing(ymHdl, ymHdl->expectedPacket);
+        for(uint8_t i=ymHdl->window;i>1;i--) /* and the ones before the last held block */
+        {
+            if(0 != (ymHdl->held & (1u << ((ymHdl->expectedPacket + i - 1) % YM_RX_BLOCKS))))
+            {
+                ymodem_rx_nak_gaps(ymHdl, i - 1);
+                break;
+            }
+        }
+        return;
+    case pktTYPE_EOT: /* the sender sends it only when every block has been ACKed, else it is a line error */
+        if((0 != ymHdl->held) || ((ymHdl->filesize >= 0) && (ymHdl->bytesRecved < ymHdl->filesize)))
+        {
+            return;
+        }
+        ymodem_rx_reply(ymHdl, ACK, ymHdl->expectedPacket);
+        ymHdl->receiveEnd(ymHdl->cbParam);
+        ymodem_rx_next_file(ymHdl);
+        return;
+    case pktTYPE_CAN: /* If sender ask to stop transer we ACK and exit */
+        ymodem_send_ctrl(ymHdl, ACK);
+        ymodem_rx_end_file(ymHdl);
+        ymodem_rx_finish(ymHdl, ymRxStatus_error);
+        return;
+    case pktTYPE_data:
+        break;
+    }
+
+    if(ofs >= ymHdl->window) /* out of the window */
+    {
+        if((0 == blkNum) && (0 == ymHdl->bytesRecved)) /* block 0, not block 256 */
+        {
+            ymodem_rx_block0_again(ymHdl);
+        }
+        else if((uint8_t)(ymHdl->expectedPacket - blkNum) <= ymHdl->window) /* already received, our ACK got lost */
+        {
+            YM_TR_INFO(ymTrace_duplicate, blkNum, 0);
+            YM_STAT_ADD(ymHdl, duplicates, 1);
+            ymodem_rx_reply(ymHdl, ACK, blkNum);
+        }
+        else
+        {
+            YM_TR_ERROR(ymTrace_seqError, blkNum, ymHdl->expectedPacket);
+            YM_STAT_ADD(ymHdl, seqErrors, 1);
+        }
+        return;
+    }
+    ymHdl->retryCount = 0;
+    ymHdl->naked &= ~(1u << slot);
+
+    if(ofs > 0) /* keep it until the missing ones arrive */
+    {
+        if(slot == ymHdl->pktSlot) /* not a duplicate */
+        {
+            ymHdl->held |= 1u << slot;
+            ymHdl->slotLen[slot] = ymHdl->pktLen;
+        }
+        else
+        {
+            YM_TR_INFO(ymTrace_duplicate, blkNum, 0);
+            YM_STAT_ADD(ymHdl, duplicates, 1);
+        }
+        ymodem_rx_reply(ymHdl, ACK, blkNum);
+        ymodem_rx_nak_gaps(ymHdl, ofs);
+        return;
+    }
+
+    /* the expected one: pass it to the user, together with the ones held after it */
+    if(0 != YM_PROF_TIME(ymHdl, ymPhase_store, ymodem_rx_deliver(ymHdl, ymHdl->data[slot], ymHdl->pktLen)))
+    {
+        return;
+    }
+    ymodem_rx_reply(ymHdl, ACK, blkNum);
+    ymHdl->expectedPacket++;
+    slot = ymHdl->expectedPacket % YM_RX_BLOCKS;
+    while(0 != (ymHdl->held & (1u << slot)))
+    {
+        if(0 != YM_PROF_TIME(ymHdl, ymPhase_store, ymodem_rx_deliver(ymHdl, ymHdl->data[slot], ymHdl->slotLen[slot])))
+        {
+            return;
+        }
+        ymHdl->held &= ~(1u << slot);
+        ymHdl->expectedPacket++;
+        slot = ymHdl->expectedPacket % YM_RX_BLOCKS;
+    }
+}
+#endif
+
+/* slot where the data of the packet being received are stored */
+static uint8_t ymodem_rx_slot(const ymodem_desc_t *ymHdl)
+{
+#if YM_RX_BLOCKS > 1
+    uint8_t blkNum = ymHdl->hdr[PACKET_SEQNO_INDEX - 1];
+    uint8_t slot = blkNum % YM_RX_BLOCKS;
+    uint8_t ofs = blkNum - ymHdl->expectedPacket;
+
+    if((rxSTATE_data == ymHdl->rxState) && (ofs < ymHdl->window) && (0 == (ymHdl->held & (1u << slot))))
+    {
+        return slot;
+    }
+    /* unexpected or duplicate: the expected one's slot is never held nor committing, use it as scratch */
+    return ymHdl->expectedPacket % YM_RX_BLOCKS;
+#else
+    return 0;
+#endif
+}
+
+/* the header has arrived: choose where the data bytes are stored, 0 on success (on error the session is aborted) */
+static int ymodem_rx_dest(ymodem_desc_t *ymHdl)
+{
+    uint8_t blkNum = ymHdl->hdr[PACKET_SEQNO_INDEX - 1];
+
+    ymHdl->pktBase = 0;
+    if((NULL != ymHdl->acquireBlockBuffer) && (rxSTATE_data == ymHdl->rxState) &&
+       (ymHdl->expectedPacket == blkNum) && (blkNum == (uint8_t)~ymHdl->hdr[PACKET_SEQNO_COMP_INDEX - 1]))
+    {
+        size_t len = ymodem_rx_file_part(ymHdl, ymHdl->pktLen);
+        if(len > 0) /* straight into the user buffer */
+        {
+            ymHdl->pktDst = ymHdl->acquireBlockBuffer(ymHdl->cbParam, ymHdl->bytesRecved, len);
+            if(NULL == ymHdl->pktDst)
+            {
+                ymodem_rx_abort(ymHdl);
+                return -1;
+            }
+            ymHdl->pktAcquired = 1;
+            ymHdl->pktStore = len;
+            return 0;
+        }
+    }
+    ymHdl->pktSlot = ymodem_rx_slot(ymHdl);
+    ymHdl->pktDst = ymHdl->data[ymHdl->pktSlot];
+    ymHdl->pktStore = min(ymHdl->pktLen, (uint16_t)YM_RX_BLOCK_BUFFER_SIZE);
+#if YM_RX_MIN_RAM
+    if((NULL == ymHdl->acquireBlockBuffer) && (rxSTATE_data == ymHdl->rxState) &&
+       (ymHdl->expectedPacket == blkNum) && (blkNum == (uint8_t)~ymHdl->hdr[PACKET_SEQNO_COMP_INDEX - 1]))
+    {
+        ymHdl->pktStreamed = 1; /* through data, one chunk at a time */
+        ymHdl->pktFile = ymodem_rx_file_part(ymHdl, ymHdl->pktLen);
+        ymHdl->pktStore = min(ymHdl->pktFile, (uint16_t)YM_RX_BLOCK_BUFFER_SIZE);
+    }
+#endif
+    return 0;
+}
+
+/* a packet (or an event) is complete, dispatch it and wait the next one */
+static void ymodem_rx_packet(ymodem_desc_t *ymHdl, pktTYPE_t pktType, uint32_t now_ms)
+{
+    uint8_t blkNum = ymHdl->hdr[PACKET_SEQNO_INDEX - 1];
+
+    if(pktTYPE_data != pktType) /* a damaged block doesn't reach the user */
+    {
+        ymodem_rx_discard(ymHdl);
+    }
+#if !YM_RX_MIN_RAM
+    else
+    {
+        ymHdl->backoff = 0;
+    }
+#endif
+
+    uint8_t rxState = ymHdl->rxState;
+    switch(ymHdl->rxState)
+    {
+    case rxSTATE_block0:
+        ymodem_rx_block0(ymHdl, pktType, blkNum);
+        break;
+    case rxSTATE_data:
+#if YM_WINDOW_MAX > 1
+        if(ymHdl->window > 1)
+        {
+            ymodem_rx_file_data_window(ymHdl, pktType, blkNum);
+            break;
+        }
+#endif
+        ymodem_rx_file_data(ymHdl, pktType, blkNum);
+        break;
+    default:
+        break;
+    }
+    if(rxSTATE_data == ymHdl->rxState)
+    {
+        if(rxSTATE_block0 == rxState) /* a file starts */
+        {
+            YM_TR_INFO(ymTrace_fileStart, 0, (uint16_t)(ymHdl->window << 8 | ymHdl->extShift));
+#if YM_RX_STATS
+            ymHdl->fileStart = now_ms;
+            ymHdl->stats.fileRetries = 0;
+#endif
+        }
+#if YM_RX_STATS
+        ymHdl->stats.fileTime = now_ms - ymHdl->fileStart;
+#endif
+    }
+    else if(rxSTATE_data == rxState) /* a file ends (at EOT, or cancelled) */
+    {
+        if(rxSTATE_block0 == ymHdl->rxState)
+        {
+            YM_TR_INFO(ymTrace_fileEnd, ymHdl->expectedPacket, 0);
+        }
+        YM_STAT_ADD(ymHdl, files, rxSTATE_block0 == ymHdl->rxState);
+#if YM_RX_STATS
+        ymHdl->stats.fileTime = now_ms - ymHdl->fileStart;
+#endif
+    }
+#if YM_RX_PROFILE
+    if((pktTYPE_data == pktType) && (rxSTATE_data == rxState)) /* a data block has been replied */
+    {
+        YM_PROF_END(ymHdl, ymPhase_turnaround, ymHdl->profReply);
+    }
+#endif
+    ymodem_rx_wait_packet(ymHdl, now_ms);
+}
+
+/* the last crc byte has arrived: validate the packet */
+static pktTYPE_t ymodem_rx_check_packet(ymodem_desc_t *ymHdl)
+{
+    uint8_t blk_n = ymHdl->hdr[PACKET_SEQNO_INDEX - 1];
+    uint8_t blk_n_compl = ymHdl->hdr[PACKET_SEQNO_COMP_INDEX - 1];
+    uint16_t crc = (ymHdl->trl[0] << 8) | (ymHdl->trl[1] << 0);
+
+    /* check block number with its complement */
+    if( blk_n != (uint8_t)(~blk_n_compl))
+    {
+        ymodem_log("block number\n");
+        YM_TR_ERROR(ymTrace_headerError, blk_n, blk_n_compl);
+        YM_STAT_ADD(ymHdl, headerErrors, 1);
+        return pktTYPE_brokenPkt;
+    }
+
+    /* chaeck crc, it has been computed while data bytes were arriving */
+    crc16_xmodem_t computedCrc;
+    computedCrc = crc16_xmodem_finalize(ymHdl->crc);
+    if( crc != computedCrc)
+    {
+        ymodem_log("crc\n");
+        YM_TR_ERROR(ymTrace_crcError, blk_n, 0);
+        YM_STAT_ADD(ymHdl, crcErrors, 1);
+        return pktTYPE_brokenPkt;
+    }
+    ymodem_log("data (blk n. %hhu)\n", blk_n);
+    YM_TR_DEBUG(ymTrace_block, blk_n, ymHdl->pktLen);
+    return pktTYPE_data;
+}
+
+/*
+ * garbage where a packet should start: the rest of the frame is still arriving, drop it until the line
+ * gets quiet, then NAK. Otherwise every byte of it would be NAKed (and counted) as a broken packet.
+ * A bad crc or block number doesn't need it: the whole frame has been received
+ */
+static void ymodem_rx_broken(ymodem_desc_t *ymHdl, uint32_t now_ms, uint32_t charWait)
+{
+    YM_STAT_ADD(ymHdl, headerErrors, 1);
+    if((0 == ymodem_rx_purge_gap(ymHdl)) || (1 != ymHdl->window) || (ymMode_crc != ymHdl->mode)) /* with a window garbage is skipped */
+    {
+        ymodem_rx_packet(ymHdl, pktTYPE_brokenPkt, now_ms);
+        return;
+    }
+    ymodem_log("purge\n");
+    YM_TR_INFO(ymTrace_purge, ymHdl->expectedPacket, 0);
+    ymHdl->pktState = pktSTATE_purge;
+#if YM_RX_MIN_RAM
+    ymHdl->pktIdx = 0; /* bytes dropped */
+#else
+    ymHdl->purgeUntil = now_ms + ymodem_rx_pkt_timeout(ymHdl); /* a line that never gets quiet */
+#endif
+    ymHdl->deadline = now_ms + min(ymodem_rx_purge_gap(ymHdl), charWait);
+}
+
+/* n data bytes have been received (stored at pktDst[pktIdx - pktBase] if they fit, and added to the crc) */
+static void ymodem_rx_data_stored(ymodem_desc_t *ymHdl, size_t n)
+{
+    ymHdl->pktIdx += n;
+#if YM_RX_MIN_RAM
+    if((0 != ymHdl->pktStreamed) && (ymHdl->pktIdx == ymHdl->pktStore) && (ymHdl->pktStore > ymHdl->pktBase)) /* a chunk is complete */
+    {
+        if(0 != ymodem_rx_store(ymHdl, ymHdl->pktDst, ymHdl->pktStore - ymHdl->pktBase))
+        {
+            ymodem_rx_abort(ymHdl);
+            return;
+        }
+        ymHdl->pktBase = ymHdl->pktStore;
+        ymHdl->pktStore = min(ymHdl->pktFile, (uint16_t)(ymHdl->pktBase + YM_RX_BLOCK_BUFFER_SIZE));
+    }
+#endif
+    if(ymHdl->pktIdx >= ymHdl->pktLen)
+    {
+        ymHdl->pktState = pktSTATE_crc;
+        ymHdl->pktIdx = 0;
+    }
+}
+
+/* return the number of bytes the parser would like to get in one go */
+static size_t ymodem_rx_wanted(const ymodem_desc_t *ymHdl)
+{
+    switch(ymHdl->pktState)
+    {
+    case pktSTATE_header:
+        return sizeof(ymHdl->hdr) - ymHdl->pktIdx;
+    case pktSTATE_data:
+        return ymHdl->pktLen - ymHdl->pktIdx;
+    case pktSTATE_crc:
+        return sizeof(ymHdl->trl) - ymHdl->pktIdx;
+    case pktSTATE_purge:
+        return SIZE_MAX;
+    default:
+        return 1;
+    }
+}
+
+ymodem_rxStatus_t ymodem_rx_start(ymodem_desc_t *ymHdl, uint32_t now_ms)
+{
+#if YM_RX_MIN_RAM
+    if((NULL == ymHdl->acquireBlockBuffer) && (NULL == ymHdl->rollback)) /* data blocks can't be streamed */
+    {
+        ymodem_rx_finish(ymHdl, ymRxStatus_error);
+        return ymHdl->status;
+    }
+#elif YM_RX_ZERO_COPY
+    if(NULL == ymHdl->acquireBlockBuffer) /* no buffer for data blocks */
+    {
+        ymodem_rx_finish(ymHdl, ymRxStatus_error);
+        return ymHdl->status;
+    }
+#endif
+    YM_TR_INFO(ymTrace_sessionStart, 0, ymHdl->mode);
+    ymHdl->status = ymRxStatus_busy;
+#if YM_RX_STATS
+    memset(&ymHdl->stats, 0, sizeof(ymHdl->stats));
+#endif
+#if YM_RX_PROFILE
+    memset(&ymHdl->prof, 0, sizeof(ymHdl->prof));
+#endif
+#if !YM_RX_MIN_RAM
+    ymHdl->adaptive = (ymHdl->minTimeout > 0);
+    ymHdl->backoff = 0;
+    ymodem_rtt_reset(&ymHdl->rtt);
+    ymodem_rtt_reset(&ymHdl->gap);
+#endif
+    ymodem_rx_next_file(ymHdl);
+    ymodem_rx_wait_packet(ymHdl, now_ms);
+    return ymHdl->status;
+}
+
+ymodem_rxStatus_t ymodem_rx_feed(ymodem_desc_t *ymHdl, const uint8_t *buf, size_t len, uint32_t now_ms)
+{
+    uint32_t charWait = ymodem_rx_arrival(ymHdl, now_ms);
+
+    while((len > 0) && (rxSTATE_done != ymHdl->rxState))
+    {
+        uint8_t c;
+        size_t n;
+
+        switch(ymHdl->pktState)
+        {
+        case pktSTATE_start:
+            c = *buf++;
+            len--;
+            switch(c)
+            {
+            case CAN:
+                ymHdl->pktState = pktSTATE_CAN;
+                break;
+            case SOH:
+                ymHdl->pktLen = PACKET_SIZE;
+                ymHdl->pktState = pktSTATE_header;
+                ymHdl->pktIdx = 0;
+                YM_PROF_PACKET(ymHdl);
+                break;
+            case STX:
+                ymHdl->pktLen = PACKET_1K_SIZE;
+                ymHdl->pktState = pktSTATE_header;
+                ymHdl->pktIdx = 0;
+                YM_PROF_PACKET(ymHdl);
+                break;
+#if YM_MAX_BLOCK_SIZE > PACKET_1K_SIZE
+            case XTX:
+                if(ymHdl->extShift <= PACKET_1K_SHIFT) /* extended blocks have not been negotiated */
+                {
+                    ymodem_log("unexpected XTX\n");
+                    YM_TR_ERROR(ymTrace_garbage, ymHdl->expectedPacket, c);
+                    ymodem_rx_broken(ymHdl, now_ms, charWait);
+                    continue;
+                }
+                ymHdl->pktLen = 1u << ymHdl->extShift;
+                ymHdl->pktState = pktSTATE_header;
+                ymHdl->pktIdx = 0;
+                YM_PROF_PACKET(ymHdl);
+                break;
+#endif
+            case EOT:
+                ymodem_log("EOT\n");
+                ymodem_rx_packet(ymHdl, pktTYPE_EOT, now_ms);
+                continue;
+            case ACK:
+                ymodem_log("ACK\n");
+                ymodem_rx_packet(ymHdl, pktTYPE_ACK, now_ms);
+                continue;
+            case NAK:
+                ymodem_log("NAK\n");
+                ymodem_rx_packet(ymHdl, pktTYPE_NAK, now_ms);
+                continue;
+            default:
+                ymodem_log("unexpected char 0x%02x\n", c);
+                YM_TR_ERROR(ymTrace_garbage, ymHdl->expectedPacket, c);
+#if YM_WINDOW_MAX > 1
+                if(ymHdl->window > 1) /* skip garbage until a packet starts, or the line gets quiet */
+                {
+                    break;
+                }
+#endif
+                ymodem_rx_broken(ymHdl, now_ms, charWait);
+                continue;
+            }
+            break;
+        case pktSTATE_CAN:
+            c = *buf++;
+            len--;
+            if (CAN == c)
+            {
+                ymodem_log("Abort trom other\n");
+                YM_TR_ERROR(ymTrace_cancel, ymHdl->expectedPacket, 0);
+                YM_STAT_ADD(ymHdl, cancels, 1);
+                ymodem_rx_packet(ymHdl, pktTYPE_CAN, now_ms);
+            }
+            else
+            {
+                YM_TR_ERROR(ymTrace_garbage, ymHdl->expectedPacket, c);
+                ymodem_rx_broken(ymHdl, now_ms, charWait);
+            }
+            continue;
+        case pktSTATE_header:
+            ymHdl->hdr[ymHdl->pktIdx++] = *buf++;
+            len--;
+            if(ymHdl->pktIdx >= sizeof(ymHdl->hdr))
+            {
+#if YM_WINDOW_MAX > 1
+                if((ymHdl->window > 1) && (ymHdl->hdr[0] != (uint8_t)~ymHdl->hdr[1])) /* not a packet: resync */
+                {
+                    ymHdl->pktState = pktSTATE_start;
+                    break;
+                }
+#endif
+                ymHdl->pktState = pktSTATE_data;
+                ymHdl->pktIdx = 0;
+                ymHdl->crc = crc16_xmodem_init();
+                if(0 != ymodem_rx_dest(ymHdl))
+                {
+                    continue;
+                }
+            }
+            break;
+        case pktSTATE_data: /* copy as many data bytes as available, computing crc in the same pass */
+            n = min(len, (size_t)(ymHdl->pktLen - ymHdl->pktIdx));
+            if(ymHdl->pktIdx < ymHdl->pktStore)
+            {
+                n = min(n, (size_t)(ymHdl->pktStore - ymHdl->pktIdx));
+                YM_PROF_CRC(ymHdl, ymHdl->crc = crc16_xmodem_copy_update(ymHdl->crc, &ymHdl->pktDst[ymHdl->pktIdx - ymHdl->pktBase], buf, n));
+            }
+            else /* not stored (padding) */
+            {
+                YM_PROF_CRC(ymHdl, ymHdl->crc = crc16_xmodem_update(ymHdl->crc, buf, n));
+            }
+            buf += n;
+            len -= n;
+            ymodem_rx_data_stored(ymHdl, n);
+            break;
+        case pktSTATE_crc:
+            ymHdl->trl[ymHdl->pktIdx++] = *buf++;
+            len--;
+            if(ymHdl->pktIdx >= sizeof(ymHdl->trl))
+            {
+                YM_PROF_END(ymHdl, ymPhase_payload, ymHdl->profPkt);
+                YM_PROF_MARK(ymHdl->profReply);
+                YM_PROF_ADD(ymHdl, ymPhase_crc, ymHdl->profCrc);
+                ymodem_rx_packet(ymHdl, ymodem_rx_check_packet(ymHdl), now_ms);
+                continue;
+            }
+            break;
+        case pktSTATE_purge: /* every byte is dropped, the line has to be quiet for a while */
+            ymHdl->deadline = now_ms + min(ymodem_rx_purge_gap(ymHdl), charWait);
+#if YM_RX_MIN_RAM
+            /* a line that never gets quiet: no more than a frame can be left of the broken one */
+            ymHdl->pktIdx = min(ymHdl->pktIdx + len, (size_t)PURGE_MAX_BYTES);
+            if(PURGE_MAX_BYTES == ymHdl->pktIdx)
+            {
+                ymHdl->deadline = now_ms;
+            }
+#else
+            if(ymodem_time_reached(ymHdl->deadline, ymHdl->purgeUntil))
+            {
+                ymHdl->deadline = ymHdl->purgeUntil;
+            }
+#endif
+            len = 0;
+            continue;
+        }
+        /* inside a packet: next char has to arrive within char timeout */
+        ymHdl->deadline = now_ms + charWait;
+    }
+    return ymHdl->status;
+}
+
+ymodem_rxStatus_t ymodem_rx_poll(ymodem_desc_t *ymHdl, uint32_t now_ms)
+{
+    if((rxSTATE_done == ymHdl->rxState) || !ymodem_time_reached(now_ms, ymHdl->deadline))
+    {
+        return ymHdl->status;
+    }
+    if(pktSTATE_purge == ymHdl->pktState) /* the line is quiet, the sender waits for our reply */
+    {
+        ymodem_rx_packet(ymHdl, pktTYPE_brokenPkt, now_ms);
+        return ymHdl->status;
+    }
+#if !YM_RX_MIN_RAM
+    if(ymodem_rx_adaptive(ymHdl) &&
+       ((pktSTATE_start == ymHdl->pktState) ? (ymHdl->pktWait < ymHdl->pktTimeout) : (now_ms - ymHdl->lastByteAt < ymHdl->charTimeout)))
+    {
+        ymodem_log("early timeout\n");
+        YM_TR_INFO(ymTrace_earlyTimeout, ymHdl->expectedPacket, pktSTATE_start != ymHdl->pktState);
+        ymHdl->backoff++;
+        ymHdl->freeRetry = 1;
+    }
+#endif
+    if(pktSTATE_start == ymHdl->pktState)
+    {
+        ymodem_log("timeout\n");
+        YM_TR_ERROR(ymTrace_timeout, ymHdl->expectedPacket, (uint16_t)min(ymodem_rx_pkt_wait(ymHdl), (uint32_t)UINT16_MAX));
+        YM_STAT_ADD(ymHdl, timeouts, rxSTATE_block0 != ymHdl->rxState); /* waiting for a file the sender may just not be started */
+        ymodem_rx_packet(ymHdl, pktTYPE_timeout, now_ms);
+    }
+    else /* a packet has been truncated */
+    {
+        ymodem_log("broken packet\n");
+        YM_TR_ERROR(ymTrace_truncated, ymHdl->expectedPacket, ymHdl->pktIdx);
+        YM_STAT_ADD(ymHdl, timeouts, 1);
+        ymodem_rx_packet(ymHdl, pktTYPE_brokenPkt, now_ms);
+    }
+    return ymHdl->status;
+}
+
+uint32_t ymodem_rx_timeout(const ymodem_desc_t *ymHdl, uint32_t now_ms)
+{
+    if(ymodem_time_reached(now_ms, ymHdl->deadline))
+    {
+        return 0;
+    }
+    return ymHdl->deadline - now_ms;
+}
+
+ymodem_rxStatus_t ymodem_rx_cancel(ymodem_desc_t *ymHdl)
+{
+    if(rxSTATE_done != ymHdl->rxState)
+    {
+        ymodem_rx_abort(ymHdl);
+    }
+    return ymHdl->status;
+}
+
+#if YM_RX_STATS
+void ymodem_get_stats(const ymodem_desc_t *ymHdl, ymodem_stats_t *stats)
+{
+    *stats = ymHdl->stats;
+}
+#endif
+
+#if YM_RX_PROFILE
+void ymodem_get_profile(const ymodem_desc_t *ymHdl, ymodem_profile_t *profile)
+{
+    *profile = ymHdl->prof;
+}
+#endif
+
+ymodem_desc_t *ymodem_init(staticYmodem_t *staticYmBuffer, void *cbParam, ymodem_maxFileSize_t maxFileSize, 
+                            ymodem_receiveStart_t receiveStart, ymodem_processData_t processData,
+                            ymodem_receiveEnd_t receiveEnd, ymodem_getByte_t getByte, ymodem_getBytes_t getBytes,
+                            ymodem_putByte_t putByte, ymodem_putBytes_t putBytes, ymodem_flush_t flush)
+{
+    if(NULL == staticYmBuffer)
+    {
+        return NULL;
+    }
+#if !YM_PORT_BOUND
+    if((NULL == putByte) && (NULL == putBytes)) /* at least one way to send is needed */
+    {
+        return NULL;
+    }
+#endif
+
+    ymodem_desc_t *ymHdl = (ymodem_desc_t *)staticYmBuffer;
+    ymHdl->cbParam = cbParam;
+    ymHdl->maxFileSize = maxFileSize;
+    ymHdl->receiveStart = receiveStart;
+    ymHdl->processData = processData;
+    ymHdl->receiveEnd = receiveEnd;
+    ymHdl->io.getByte = getByte;
+    ymHdl->io.getBytes = getBytes;
+    ymHdl->io.putByte = putByte;
+    ymHdl->io.putBytes = putBytes;
+    ymHdl->io.flush = flush;
+    ymHdl->rxState = rxSTATE_done;
+    ymHdl->status = ymRxStatus_error;
+    ymHdl->mode = ymMode_crc;
+    ymHdl->windowMax = YM_WINDOW_MAX;
+    ymHdl->shiftMax = YM_MAX_BLOCK_SHIFT;
+    ymHdl->pktSlot = 0;
+    ymHdl->pktDst = ymHdl->data[0];
+    ymHdl->pktStore = 0;
+    ymHdl->pktBase = 0;
+    ymHdl->pktFile = 0;
+    ymHdl->pktStreamed = 0;
+    ymHdl->rollback = NULL;
+    ymHdl->commitWait = NULL;
+    ymHdl->commitPending = 0;
+    ymHdl->acquireBlockBuffer = NULL;
+    ymHdl->releaseBlockBuffer = NULL;
+    ymHdl->pktAcquired = 0;
+#if YM_RX_STATS
+    memset(&ymHdl->stats, 0, sizeof(ymHdl->stats));
+#endif
+#if YM_RX_PROFILE
+    memset(&ymHdl->prof, 0, sizeof(ymHdl->prof));
+#endif
+    ymodem_set_timing(ymHdl, &defaultTiming, NULL);
+    return ymHdl;
+}
+
+int ymodem_set_async_commit(ymodem_desc_t *ymHdl, ymodem_commitWait_t commitWait)
+{
+#if (YM_RX_BLOCKS > 1) || YM_RX_ZERO_COPY /* with user buffers blocks are never committed from data */
+    ymHdl->commitWait = commitWait;
+    return 0;
+#else
+    return (NULL == commitWait) ? 0 : -1;
+#endif
+}
+
+void ymodem_set_block_buffers(ymodem_desc_t *ymHdl, ymodem_acquireBlockBuffer_t acquireBlockBuffer, ymodem_releaseBlockBuffer_t releaseBlockBuffer)
+{
+    ymHdl->acquireBlockBuffer = acquireBlockBuffer;
+    ymHdl->releaseBlockBuffer = releaseBlockBuffer;
+}
+
+void ymodem_set_rollback(ymodem_desc_t *ymHdl, ymodem_rollback_t rollback)
+{
+    ymHdl->rollback = rollback;
+}
+
+void ymodem_set_mode(ymodem_desc_t *ymHdl, ymodem_mode_t mode)
+{
+    ymHdl->mode = mode;
+}
+
+void ymodem_set_window(ymodem_desc_t *ymHdl, uint8_t window)
+{
+    if(0 == window)
+    {
+        window = 1;
+    }
+    ymHdl->windowMax = min(window, (uint8_t)YM_WINDOW_MAX);
+}
+
+void ymodem_set_block_size(ymodem_desc_t *ymHdl, size_t blockSize)
+{
+    uint8_t shift = PACKET_1K_SHIFT;
+
+    while((shift < YM_MAX_BLOCK_SHIFT) && (((size_t)2 << shift) <= blockSize))
+    {
+        shift++;
+    }
+    ymHdl->shiftMax = shift;
+}
+
+void ymodem_set_timing(ymodem_desc_t *ymHdl, const ymodem_timing_t *timing, ymodem_getTime_t getTime)
+{
+#if YM_RX_MIN_RAM
+    (void)timing; /* fixed at build time */
+#else
+    ymHdl->pktTimeout = max(timing->pktTimeout, (uint32_t)1);
+    ymHdl->charTimeout = max(timing->charTimeout, (uint32_t)1);
+    ymHdl->minTimeout = timing->minTimeout;
+    ymHdl->maxRetry = max(timing->maxRetry, (uint8_t)1);
+    ymHdl->purgeGap = timing->purgeGap;
+    ymHdl->pollInterval = timing->pollInterval;
+    ymHdl->startTimeout = timing->startTimeout;
+#endif
+    ymHdl->getTime = getTime;
+}
+
+int ymodem_receive(ymodem_desc_t *ymHdl)
+{
+    /* without getTime the clock is virtual: it only advances when a read expires, as every wait restarts on each byte */
+    uint32_t now = (NULL != ymHdl->getTime) ? ymHdl->getTime(ymHdl->cbParam) : 0;
+    ymodem_rxStatus_t status;
+    uint8_t buf[64]; /* header, control chars and data bytes not stored (padding) */
+
+#if !YM_PORT_BOUND
+    if((NULL == ymHdl->io.getByte) && (NULL == ymHdl->io.getBytes)) /* no way to receive */
+    {
+        return ymRxStatus_error;
+    }
+#endif
+
+    status = ymodem_rx_start(ymHdl, now);
+#if !YM_RX_MIN_RAM
+    if(NULL == ymHdl->getTime) /* nothing can be measured */
+    {
+        ymHdl->adaptive = 0;
+    }
+#endif
+    while(ymRxStatus_busy == status)
+    {
+        uint32_t tout = ymodem_rx_timeout(ymHdl, now);
+        int32_t n;
+
+        if((pktSTATE_data == ymHdl->pktState) && (ymHdl->pktIdx < ymHdl->pktStore)) /* data bytes are read straight into place */
+        {
+            uint8_t *dst = &ymHdl->pktDst[ymHdl->pktIdx - ymHdl->pktBase];
+            n = ymodem_read(&ymHdl->io, ymHdl->cbParam, dst, ymHdl->pktStore - ymHdl->pktIdx, tout);
+            if(NULL != ymHdl->getTime)
+            {
+                now = ymHdl->getTime(ymHdl->cbParam);
+            }
+            if(n > 0)
+            {
+                YM_PROF_CRC(ymHdl, ymHdl->crc = crc16_xmodem_update(ymHdl->crc, dst, n)); /* while the chunk is still in cache */
+                ymHdl->deadline = now + ymodem_rx_arrival(ymHdl, now);
+                ymodem_rx_data_stored(ymHdl, n);
+                status = ymHdl->status; /* storing a chunk may fail */
+                continue;
+            }
+        }
+        else
+        {
+            n = ymodem_read(&ymHdl->io, ymHdl->cbParam, buf, min(sizeof(buf), ymodem_rx_wanted(ymHdl)), tout);
+            if(NULL != ymHdl->getTime)
+            {
+                now = ymHdl->getTime(ymHdl->cbParam);
+            }
+            if(n > 0)
+            {
+                status = ymodem_rx_feed(ymHdl, buf, n, now);
+                continue;
+            }
+        }
+        if(n < 0) /* the transport is gone, nothing more will arrive */
+        {
+            status = ymodem_rx_cancel(ymHdl);
+            break;
+        }
+        if(NULL == ymHdl->getTime)
+        {
+            now += tout;
+        }
+        status = ymodem_rx_poll(ymHdl, now);
+    }
+
+    return status;
+}
+
+_Static_assert(YM_FILE_NAME_LENGTH + YM_FILE_SIZE_LENGTH + sizeof(EXT_MAGIC) + 2 <= PACKET_1K_SIZE, "file info doesn't fit block 0");
+
+struct ymodem_tx_desc
+{
+    YM_TX_FIELDS(YM_FIELD)
+};
+
+_Static_assert(sizeof(((struct ymodem_tx_desc *)0)->frame[0]) == PACKET_HEADER + YM_MAX_BLOCK_SIZE + PACKET_TRAILER, "sender frames sized for another packet format");
+
+/* get a char from the receiver whithin tout, -1 on timeout */
+static int ymodem_tx_get(ymodem_tx_desc_t *ymTxHdl, uint32_t tout)
+{
+    uint8_t c;
+
+    if(ymodem_read(&ymTxHdl->io, ymTxHdl->cbParam, &c, 1, tout) <= 0)
+    {
+        return -1;
+    }
+    return c;
+}
+
+/* a CAN has been received: true if a second one follows, so the receiver is aborting */
+static int ymodem_tx_cancelled(ymodem_tx_desc_t *ymTxHdl)
+{
+    return CAN == ymodem_tx_get(ymTxHdl, ymTxHdl->charTimeout);
+}
+
+static void ymodem_tx_send_frame(ymodem_tx_desc_t *ymTxHdl, uint8_t idx)
+{
+    ymodem_put_bytes(&ymTxHdl->io, ymTxHdl->cbParam, ymTxHdl->frame[idx], ymTxHdl->frameLen[idx]);
+    ymodem_flush(&ymTxHdl->io, ymTxHdl->cbParam);
+}
+
+/* complete frame idx around its pktLen data bytes: header and crc */
+static void ymodem_tx_frame(ymodem_tx_desc_t *ymTxHdl, uint8_t idx, uint8_t start, uint8_t blkNum, size_t pktLen)
+{
+    uint8_t *frame = ymTxHdl->frame[idx];
+    crc16_xmodem_t crc;
+
+    frame[0] = start;
+    frame[PACKET_SEQNO_INDEX] = blkNum;
+    frame[PACKET_SEQNO_COMP_INDEX] = ~blkNum;
+    crc = crc16_xmodem_init();
+    crc = crc16_xmodem_update(crc, &frame[PACKET_HEADER], pktLen);
+    crc = crc16_xmodem_finalize(crc);
+    frame[PACKET_HEADER + pktLen] = crc >> 8;
+    frame[PACKET_HEADER + pktLen + 1] = crc & 0xFF;
+    ymTxHdl->frameLen[idx] = pktLen + PACKET_OVERHEAD;
+}
+
+/* write val in decimal (null terminated) into str, return its length */
+static size_t ymodem_tx_utoa(char *str, size_t val)
+{
+    char digits[YM_FILE_SIZE_LENGTH];
+    size_t len = 0;
+
+    do
+    {
+        digits[len++] = '0' + (val % 10);
+        val /= 10;
+    }while((0 != val) && (len < sizeof(digits) - 1));
+
+    for(size_t i=0;i<len;i++)
+    {
+        str[i] = digits[len - 1 - i];
+    }
+    str[len] = 0;
+    return len;
+}
+
+/* build block 0 of the next file into frame idx: 0 on success, 1 at the end of the batch (empty block 0), other values on error */
+static int32_t ymodem_tx_block0(ymodem_tx_desc_t *ymTxHdl, uint8_t idx)
+{
+    uint8_t *data = &ymTxHdl->frame[idx][PACKET_HEADER];
+    size_t filesize = 0;
+    int32_t res;
+
+    memset(data, 0, PACKET_1K_SIZE);
+    res = ymTxHdl->sendStart(ymTxHdl->cbParam, (char *)data, YM_FILE_NAME_LENGTH, &filesize);
+    if(1 == res) /* a null pathname terminates the batch */
+    {
+        ymodem_tx_frame(ymTxHdl, idx, SOH, 0, PACKET_SIZE);
+        return res;
+    }
+    if(0 != res)
+    {
+        return res;
+    }
+
+    data[YM_FILE_NAME_LENGTH - 1] = 0; /* null termination, just in case */
+    size_t len = (uint8_t *)ymodem_port_memchr(data, 0, YM_FILE_NAME_LENGTH) - data + 1;
+    len += ymodem_tx_utoa((char *)&data[len], filesize) + 1;
+#if YM_EXT_ENABLED
+    /* advertise extensions, the receiver will tell the block size and the window to use */
+    memcpy(&data[len], EXT_MAGIC, sizeof(EXT_MAGIC) - 1);
+    len += sizeof(EXT_MAGIC) - 1;
+    data[len++] = YM_MAX_BLOCK_SHIFT;
+    data[len++] = YM_WINDOW_MAX;
+#endif
+    if(len <= PACKET_SIZE)
+    {
+        ymodem_tx_frame(ymTxHdl, idx, SOH, 0, PACKET_SIZE);
+    }
+    else
+    {
+        ymodem_tx_frame(ymTxHdl, idx, STX, 0, PACKET_1K_SIZE);
+    }
+    return 0;
+}
+
+/* read the next data block into frame idx: 0 on success (frameLen is 0 at the end of file), other values on error */
+static int32_t ymodem_tx_data_block(ymodem_tx_desc_t *ymTxHdl, uint8_t idx, uint8_t blkNum)
+{
+    uint8_t *data = &ymTxHdl->frame[idx][PACKET_HEADER];
+    size_t blkSz = (size_t)1 << ymTxHdl->blkShift;
+    int32_t n;
+
+    n = ymTxHdl->readData(ymTxHdl->cbParam, data, blkSz);
+    if((n < 0) || ((size_t)n > blkSz))
+    {
+        return -1;
+    }
+    if(0 == n) /* end of file */
+    {
+        ymTxHdl->frameLen[idx] = 0;
+        return 0;
+    }
+
+    /* smallest frame the data fits in */
+    uint8_t start = STX;
+    size_t pktLen = PACKET_1K_SIZE;
+    if(n <= PACKET_SIZE)
+    {
+        start = SOH;
+        pktLen = PACKET_SIZE;
+    }
+#if YM_MAX_BLOCK_SIZE > PACKET_1K_SIZE
+    else if(n > PACKET_1K_SIZE)
+    {
+        start = XTX;
+        pktLen = blkSz;
+    }
+#endif
+    memset(&data[n], CPMEOF, pktLen - n);
+    ymodem_tx_frame(ymTxHdl, idx, start, blkNum, pktLen);
+    return 0;
+}
+
+/* wait the receiver asking for a file or its data ('C' or 'G'): 0 on success, -1 if the receiver is gone or aborted */
+static int32_t ymodem_tx_wait_start(ymodem_tx_desc_t *ymTxHdl)
+{
+    uint8_t retryCount = 0;
+
+    while(retryCount < ymTxHdl->maxRetry)
+    {
+        int c = ymodem_tx_get(ymTxHdl, ymTxHdl->pktTimeout);
+        switch(c)
+        {
+        case -1:
+            retryCount++;
+            break;
+        case CRC16:
+            ymTxHdl->mode = ymMode_crc;
+            return 0;
+        case CRC16_G:
+            ymTxHdl->mode = ymMode_g;
+            return 0;
+        case CAN:
+            if(ymodem_tx_cancelled(ymTxHdl))
+            {
+                return -1;
+            }
+            break;
+#if YM_EXT_ENABLED
+        case EXT_ACCEPT: /* extensions accepted, block size and window follow */
+            c = ymodem_tx_get(ymTxHdl, ymTxHdl->charTimeout);
+            if((c >= PACKET_1K_SHIFT) && (c <= YM_MAX_BLOCK_SHIFT))
+            {
+                ymTxHdl->blkShift = c;
+            }
+            c = ymodem_tx_get(ymTxHdl, ymTxHdl->charTimeout);
+            if((c >= 1) && (c <= YM_WINDOW_MAX))
+            {
+                ymTxHdl->window = c;
+            }
+            break;
+#endif
+        default: /* unexpected char, ignore it */
+            break;
+        }
+    }
+    return -1;
+}
+
+/* block number following ACK or NAK with a window, checked with its complement: -1 if it is missing or damaged */
+static int ymodem_tx_get_blknum(ymodem_tx_desc_t *ymTxHdl)
+{
+    int n = ymodem_tx_get(ymTxHdl, ymTxHdl->charTimeout);
+
+    if((n < 0) || ((n ^ 0xFF) != ymodem_tx_get(ymTxHdl, ymTxHdl->charTimeout)))
+    {
+        return -1;
+    }
+    return n;
+}
+
+/* with a window ACK and NAK are followed by a block number: true if it is blkNum */
+static int ymodem_tx_reply_for(ymodem_tx_desc_t *ymTxHdl, uint8_t blkNum)
+{
+    if(1 == ymTxHdl->window)
+    {
+        return 1;
+    }
+    return blkNum == ymodem_tx_get_blknum(ymTxHdl);
+}
+
+/* time (ms) of the sender, 0 without getTime: the waits are measured counting the replies */
+static inline uint32_t ymodem_tx_now(const ymodem_tx_desc_t *ymTxHdl)
+{
+    return (NULL != ymTxHdl->getTime) ? ymTxHdl->getTime(ymTxHdl->cbParam) : 0;
+}
+
+/*
+ * wait the ACK of the frame being sent (block blkNum), sending it again on NAK or timeout: 0 on success, -1 on failure.
+ * In stop and wait an ACK carries no block number. For a data block (data set) one back in less than half the fastest
+ * ACK seen may be a duplicate of the previous one, and taking it would put us a block ahead of the receiver: it is
+ * taken only if nothing else arrives within twice the fastest ACK, otherwise the reply of this frame follows it
+ */
+static int32_t ymodem_tx_wait_ack(ymodem_tx_desc_t *ymTxHdl, uint8_t blkNum, int data)
+{
+    uint8_t retryCount = 0;
+    uint32_t sentAt = ymodem_tx_now(ymTxHdl);
+    int next = -2; /* char already read, -2 if none */
+
+    while(1)
+    {
+        /*
+         * on a lost ACK the receiver NAKs after pktTimeout: wait a bit longer, otherwise its NAK crosses
+         * our retransmission and every later reply would be taken for the one of the next block
+         */
+        int c = (-2 != next) ? next : ymodem_tx_get(ymTxHdl, ymTxHdl->pktTimeout + ymTxHdl->charTimeout);
+        next = -2;
+        switch(c)
+        {
+        case ACK:
+            if(!ymodem_tx_reply_for(ymTxHdl, blkNum))
+            {
+                break;
+            }
+            if(data && (NULL != ymTxHdl->getTime))
+            {
+                uint32_t rtt = ymodem_tx_now(ymTxHdl) - sentAt;
+                if(rtt < ymTxHdl->ackMin / 2) /* too early for this frame */
+                {
+                    next = ymodem_tx_get(ymTxHdl, 2 * ymTxHdl->ackMin);
+                    if(-1 != next)
+                    {
+                        break;
+                    }
+                }
+                if((0 == ymTxHdl->ackMin) || (rtt < ymTxHdl->ackMin))
+                {
+                    ymTxHdl->ackMin = rtt;
+                }
+            }
+            return 0;
+        case CAN:
+            if(ymodem_tx_cancelled(ymTxHdl))
+            {
+                return -1;
+            }
+            break;
+        case NAK:
+            if(!ymodem_tx_reply_for(ymTxHdl, blkNum))
+            {
+                break;
+            }
+            /* fall through */
+        case -1:
+            if(++retryCount >= ymTxHdl->maxRetry)
+            {
+                return -1;
+            }
+            ymodem_tx_send_frame(ymTxHdl, ymTxHdl->cur);
+            sentAt = ymodem_tx_now(ymTxHdl);
+            break;
+        default: /* unexpected char, ignore it */
+            break;
+        }
+    }
+}
+
+/*
+ * drop what the receiver sent so far, just checking whether it is aborting: 0 on success, -1 on abort.
+ * YMODEM-g blocks are not acknowledged; in stop and wait what is left (a duplicated ACK) would be
+ * taken for the reply of the next frame
+ */
+static int32_t ymodem_tx_check_cancel(ymodem_tx_desc_t *ymTxHdl)
+{
+    int c;
+
+    while(-1 != (c = ymodem_tx_get(ymTxHdl, 0)))
+    {
+        if((CAN == c) && ymodem_tx_cancelled(ymTxHdl))
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+#if YM_WINDOW_MAX > 1
+/* ring index of the frame ofs blocks after the oldest one not ACKed */
+static inline uint8_t ymodem_tx_ring(const ymodem_tx_desc_t *ymTxHdl, uint8_t ofs)
+{
+    return (ymTxHdl->cur + ofs) % YM_TX_FRAMES;
+}
+
+/* ms left of the wait for the oldest block not ACKed, started at waitStart with replies read since */
+static uint32_t ymodem_tx_wait_left(const ymodem_tx_desc_t *ymTxHdl, uint32_t waitStart, uint32_t replies)
+{
+    uint32_t spent = (NULL != ymTxHdl->getTime) ? ymTxHdl->getTime(ymTxHdl->cbParam) - waitStart : replies * ymTxHdl->charTimeout;
+
+    return (spent < ymTxHdl->pktTimeout) ? ymTxHdl->pktTimeout - spent : 0;
+}
+
+/*
+ * send data blocks keeping up to window of them in flight, only NAKed ones are sent again.
+ * The oldest one is sent again when its wait expires: replies not moving the window don't
+ * restart it, or a receiver asking for something we can't give would keep us waiting forever
+ */
+static int32_t ymodem_tx_blocks_window(ymodem_tx_desc_t *ymTxHdl, uint8_t *blkNum)
+{
+    uint8_t base = *blkNum; /* oldest block not ACKed */
+    uint8_t inFlight = 0;
+    uint32_t acked = 0; /* bit n set: block base + n has been ACKed */
+    uint8_t retryCount = 0;
+    uint32_t waitStart = ymodem_tx_now(ymTxHdl);
+    uint32_t replies = 0; /* read since waitStart */
+    int eof = 0;
+
+    ymTxHdl->cur = 0;
+    while(1)
+    {
+        /* fill the window, blocks are read while the previous ones are on their way */
+        while(!eof && (inFlight < ymTxHdl->window))
+        {
+            uint8_t idx = ymodem_tx_ring(ymTxHdl, inFlight);
+            if(0 != ymodem_tx_data_block(ymTxHdl, idx, base + inFlight))
+            {
+                return -1;
+            }
+            if(0 == ymTxHdl->frameLen[idx])
+            {
+                eof = 1;
+                break;
+            }
+            ymodem_tx_send_frame(ymTxHdl, idx);
+            inFlight++;
+        }
+        if(0 == inFlight) /* every block has been ACKed */
+        {
+            *blkNum = base;
+            return 0;
+        }
+
+        int c = ymodem_tx_get(ymTxHdl, ymodem_tx_wait_left(ymTxHdl, waitStart, replies));
+        int n;
+        uint8_t ofs;
+        replies++;
+        switch(c)
+        {
+        case ACK:
+            n = ymodem_tx_get_blknum(ymTxHdl);
+            ofs = n - base;
+            if((n >= 0) && (ofs < inFlight))
+            {
+                acked |= 1u << ofs;
+            }
+            break;
+        case NAK:
+            n = ymodem_tx_get_blknum(ymTxHdl);
+            ofs = n - base;
+            if((n >= 0) && (ofs == inFlight)) /* it asks for the block after the ones in flight: it has them all, the ACKs got lost */
+            {
+                acked = (uint32_t)((1ull << inFlight) - 1);
+                break;
+            }
+            if((n < 0) || (ofs >= inFlight) || (0 != (acked & (1u << ofs))))
+            {
+                break;
+            }
+            if(0 == ofs)
+            {
+                if(++retryCount >= ymTxHdl->maxRetry)
+                {
+                    return -1;
+                }
+                waitStart = ymodem_tx_now(ymTxHdl);
+                replies = 0;
+            }
+            ymodem_tx_send_frame(ymTxHdl, ymodem_tx_ring(ymTxHdl, ofs));
+            break;
+        case CAN:
+            if(ymodem_tx_cancelled(ymTxHdl))
+            {
+                return -1;
+            }
+            break;
+        case -1: /* no news from the receiver: send the oldest block again */
+            if(++retryCount >= ymTxHdl->maxRetry)
+            {
+                return -1;
+            }
+            ymodem_tx_send_frame(ymTxHdl, ymTxHdl->cur);
+            waitStart = ymodem_tx_now(ymTxHdl);
+            replies = 0;
+            break;
+        default: /* unexpected char, ignore it */
+            break;
+        }
+        if(0 != (acked & 1)) /* the oldest block has been ACKed: its wait is over */
+        {
+            waitStart = ymodem_tx_now(ymTxHdl);
+            replies = 0;
+        }
+        while(0 != (acked & 1)) /* slide the window */
+        {
+            acked >>= 1;
+            base++;
+            inFlight--;
+            ymTxHdl->cur = ymodem_tx_ring(ymTxHdl, 1);
+            retryCount = 0;
+        }
+    }
+}
+#endif
+
+/* send data blocks of the current file from block *blkNum, set it to the number following the last one: 0 on success, -1 on failure */
+static int32_t ymodem_tx_blocks(ymodem_tx_desc_t *ymTxHdl, uint8_t *blkNum)
+{
+#if YM_WINDOW_MAX > 1
+    if(ymTxHdl->window > 1)
+    {
+        return ymodem_tx_blocks_window(ymTxHdl, blkNum);
+    }
+#endif
+    ymTxHdl->cur = 0;
+    if(0 != ymodem_tx_data_block(ymTxHdl, ymTxHdl->cur, *blkNum))
+    {
+        return -1;
+    }
+    while(0 != ymTxHdl->frameLen[ymTxHdl->cur])
+    {
+        if(0 != ymodem_tx_check_cancel(ymTxHdl))
+        {
+            return -1;
+        }
+        ymodem_tx_send_frame(ymTxHdl, ymTxHdl->cur);
+
+        /* while the block is on its way, prepare the next one */
+        if(0 != ymodem_tx_data_block(ymTxHdl, ymTxHdl->cur ^ 1, *blkNum + 1))
+        {
+            return -1;
+        }
+
+        if(ymMode_crc == ymTxHdl->mode)
+        {
+            if(0 != ymodem_tx_wait_ack(ymTxHdl, *blkNum, 1))
+            {
+                return -1;
+            }
+        }
+        else if(0 != ymodem_tx_check_cancel(ymTxHdl))
+        {
+            return -1;
+        }
+        ymTxHdl->cur ^= 1;
+        (*blkNum)++;
+    }
+    return 0;
+}
+
+/* send data blocks and EOT of the current file: 0 on success, -1 on failure */
+static int32_t ymodem_tx_file_data(ymodem_tx_desc_t *ymTxHdl)
+{
+    uint8_t blkNum = 1;
+
+    if(0 != ymodem_tx_blocks(ymTxHdl, &blkNum))
+    {
+        return -1;
+    }
+
+    /* end of file */
+    ymTxHdl->frame[ymTxHdl->cur][0] = EOT;
+    ymTxHdl->frameLen[ymTxHdl->cur] = 1;
+    if(0 != ymodem_tx_check_cancel(ymTxHdl))
+    {
+        return -1;
+    }
+    ymodem_tx_send_frame(ymTxHdl, ymTxHdl->cur);
+    return ymodem_tx_wait_ack(ymTxHdl, blkNum, 0);
+}
+
+/* we give up asking receiver to abort transfer */
+static int ymodem_tx_abort(ymodem_tx_desc_t *ymTxHdl, int fileOpen)
+{
+    if(fileOpen)
+    {
+        ymTxHdl->sendEnd(ymTxHdl->cbParam);
+    }
+    ymodem_send_abort(&ymTxHdl->io, ymTxHdl->cbParam);
+    return 1;
+}
+
+ymodem_tx_desc_t *ymodem_tx_init(staticYmodemTx_t *staticYmBuffer, void *cbParam, ymodem_sendStart_t sendStart,
+                            ymodem_readData_t readData, ymodem_sendEnd_t sendEnd,
+                            ymodem_getByte_t getByte, ymodem_getBytes_t getBytes,
+                            ymodem_putByte_t putByte, ymodem_putBytes_t putBytes, ymodem_flush_t flush)
+{
+    if(NULL == staticYmBuffer)
+    {
+        return NULL;
+    }
+#if !YM_PORT_BOUND
+    if((NULL == getByte) && (NULL == getBytes)) /* the sender always waits for the receiver */
+    {
+        return NULL;
+    }
+    if((NULL == putByte) && (NULL == putBytes)) /* at least one way to send is needed */
+    {
+        return NULL;
+    }
+#endif
+
+    ymodem_tx_desc_t *ymTxHdl = (ymodem_tx_desc_t *)staticYmBuffer;
+    ymTxHdl->cbParam = cbParam;
+    ymTxHdl->sendStart = sendStart;
+    ymTxHdl->readData = readData;
+    ymTxHdl->sendEnd = sendEnd;
+    ymTxHdl->io.getByte = getByte;
+    ymTxHdl->io.getBytes = getBytes;
+    ymTxHdl->io.putByte = putByte;
+    ymTxHdl->io.putBytes = putBytes;
+    ymTxHdl->io.flush = flush;
+    ymTxHdl->mode = ymMode_crc;
+    ymodem_tx_set_timing(ymTxHdl, &defaultTiming, NULL);
+    return ymTxHdl;
+}
+
+void ymodem_tx_set_timing(ymodem_tx_desc_t *ymTxHdl, const ymodem_timing_t *timing, ymodem_getTime_t getTime)
+{
+    ymTxHdl->pktTimeout = max(timing->pktTimeout, (uint32_t)1);
+    ymTxHdl->charTimeout = max(timing->charTimeout, (uint32_t)1);
+    ymTxHdl->maxRetry = max(timing->maxRetry, (uint8_t)1);
+    ymTxHdl->getTime = getTime;
+}
+
+int ymodem_send(ymodem_tx_desc_t *ymTxHdl)
+{
+    ymTxHdl->ackMin = 0;
+    while(1)
+    {
+        ymTxHdl->cur = 0;
+        ymTxHdl->blkShift = PACKET_1K_SHIFT;
+        ymTxHdl->window = 1;
+
+        /* wait the receiver asking for the next file */
+        if(0 != ymodem_tx_wait_start(ymTxHdl))
+        {
+            return ymodem_tx_abort(ymTxHdl, 0);
+        }
+
+        int32_t res = ymodem_tx_block0(ymTxHdl, ymTxHdl->cur);
+        if(1 == res) /* end of batch, the receiver ACKs the empty block 0 also in YMODEM-g */
+        {
+            ymodem_tx_send_frame(ymTxHdl, ymTxHdl->cur);
+            return (0 == ymodem_tx_wait_ack(ymTxHdl, 0, 0)) ? 0 : 1;
+        }
+        if(0 != res)
+        {
+            return ymodem_tx_abort(ymTxHdl, 0);
+        }
+        ymodem_tx_send_frame(ymTxHdl, ymTxHdl->cur);
+        if((ymMode_crc == ymTxHdl->mode) && (0 != ymodem_tx_wait_ack(ymTxHdl, 0, 0)))
+        {
+            return ymodem_tx_abort(ymTxHdl, 1);
+        }
+
+        /* wait the receiver asking for data (maybe accepting extended blocks) */
+        if((0 != ymodem_tx_wait_start(ymTxHdl)) || (0 != ymodem_tx_file_data(ymTxHdl)))
+        {
+            return ymodem_tx_abort(ymTxHdl, 1);
+        }
+        ymTxHdl->sendEnd(ymTxHdl->cbParam);
+    }
 }
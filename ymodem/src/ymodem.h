@@ -18,6 +18,10 @@
 #include <stdint.h>
 #include <stddef.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 /**
  * @brief callback to get maximum file size supported
  *
@@ -32,7 +36,7 @@ typedef size_t (*ymodem_maxFileSize_t)(void *param);
  * it is supposed to intializa storage structures (eg. open file)
  *
  * @param param user parameter
- * @param filename null terminated file name string
+ * @param filename null terminated file name string (with YM_RX_MIN_RAM it is valid only during the call)
  * @return 0 on success
  */
 typedef int32_t (*ymodem_receiveStart_t)(void *param, const char *filename);
@@ -49,6 +53,56 @@ typedef int32_t (*ymodem_receiveStart_t)(void *param, const char *filename);
  */
 typedef int32_t (*ymodem_processData_t)(void *param, const uint8_t *buffer, size_t buffSz);
 
+/**
+ * @brief callback function waiting the end of the oldest commit started by processData
+ *
+ * used only with asynchronous commit (see ymodem_set_async_commit())
+ *
+ * @param param user parameter
+ * @return 0 if the data have been stored
+ */
+typedef int32_t (*ymodem_commitWait_t)(void *param);
+
+/**
+ * @brief callback function providing the buffer where the next data block is received
+ *
+ * used only with block buffers (see ymodem_set_block_buffers()): the data bytes are
+ * written straight into the final destination (eg. a mmap'd window of the file, a flash
+ * page buffer), without passing through the receiver block buffer
+ *
+ * @param param user parameter
+ * @param offset position of the first byte of the block within the file
+ * @param maxLen bytes of the block belonging to the file (padding is not stored)
+ * @return buffer of at least maxLen bytes, NULL on error (the session is aborted)
+ */
+typedef uint8_t *(*ymodem_acquireBlockBuffer_t)(void *param, size_t offset, size_t maxLen);
+
+/**
+ * @brief callback function giving back the buffer got by acquireBlockBuffer
+ *
+ * it is called once per acquired buffer. With ok set the block has been verified and
+ * its bytes are final (it takes the place of processData). Otherwise the block has
+ * been damaged or the session is aborting: the content of the buffer is not valid and
+ * has to be ignored, the same offset will be acquired again if the block is resent
+ *
+ * @param param user parameter
+ * @param ok 1 if the block is good, 0 if it has to be discarded
+ * @return 0 on success (ignored if ok is 0)
+ */
+typedef int32_t (*ymodem_releaseBlockBuffer_t)(void *param, int ok);
+
+/**
+ * @brief callback function discarding the provisional data of a damaged block
+ *
+ * used only with YM_RX_MIN_RAM: the bytes passed to processData from offset on are not
+ * valid, the next processData goes on from offset
+ *
+ * @param param user parameter
+ * @param offset position within the file of the first byte to discard
+ * @return 0 on success
+ */
+typedef int32_t (*ymodem_rollback_t)(void *param, size_t offset);
+
 /**
  * @brief callback function called when end receiving bytes of a file
  *
@@ -59,15 +113,68 @@ typedef int32_t (*ymodem_processData_t)(void *param, const uint8_t *buffer, size
  */
 typedef int32_t (*ymodem_receiveEnd_t)(void *param);
 
+/**
+ * @brief callback function called to start sending a file
+ *
+ * it is supposed to open the next file of the batch (eg. open file) and to
+ * return its name and size
+ *
+ * @param param user parameter
+ * @param filename buffer where to store the null terminated file name
+ * @param filenameSz size of filename buffer
+ * @param filesize where to store the file size
+ * @return 0 on success, 1 if there are no more files to send, any other value on error
+ */
+typedef int32_t (*ymodem_sendStart_t)(void *param, char *filename, size_t filenameSz, size_t *filesize);
+
+/**
+ * @brief callback function called to get the data of the next block
+ *
+ * it is supposed to read bytes from storage. Like fread() it has to fill the whole
+ * buffer, unless the end of the file is reached
+ *
+ * @param param user parameter
+ * @param buffer array where to store bytes read
+ * @param buffSz array size
+ * @return number of bytes stored into buffer (0 at end of file), negative on error
+ */
+typedef int32_t (*ymodem_readData_t)(void *param, uint8_t *buffer, size_t buffSz);
+
+/**
+ * @brief callback function called when end sending a file
+ *
+ * it is supposed to finalize storage structures (eg. close file)
+ *
+ * @param param user parameter
+ * @return 0 on success
+ */
+typedef int32_t (*ymodem_sendEnd_t)(void *param);
+
 /**
  * @brief function returning byte received whithin timeout
  *
  * @param param user parameter
  * @param tout timeout in ms
- * @return the byte received as an unsigned char cast to an int or -1 on timeout
+ * @return the byte received as an unsigned char cast to an int, -1 on timeout or another
+ *         negative value on error (ymodem_receive() ends the session)
  */
 typedef int (*ymodem_getByte_t)(void *param, uint32_t tout);
 
+/**
+ * @brief function receiving up to len bytes whithin timeout
+ *
+ * it has to return as soon as at least one byte is available (like read() does),
+ * the library calls it again for the remaining bytes
+ *
+ * @param param user parameter
+ * @param buf buffer where to store received bytes
+ * @param len maximum number of bytes to store into buf
+ * @param tout timeout in ms
+ * @return number of bytes stored into buf, 0 on timeout or -1 on error (ymodem_receive()
+ *         ends the session, eg. when the line is closed)
+ */
+typedef int32_t (*ymodem_getBytes_t)(void *param, uint8_t *buf, size_t len, uint32_t tout);
+
 /**
  * @brief output the byte c
  *
@@ -76,32 +183,423 @@ typedef int (*ymodem_getByte_t)(void *param, uint32_t tout);
  */
 typedef void (*ymodem_putByte_t)(void *param, uint8_t c);
 
+/**
+ * @brief output len bytes
+ *
+ * bytes may be buffered by the user until the flush callback is called
+ *
+ * @param param user parameter
+ * @param buf bytes to output
+ * @param len number of bytes to output
+ */
+typedef void (*ymodem_putBytes_t)(void *param, const uint8_t *buf, size_t len);
+
+/**
+ * @brief send out any byte buffered so far
+ *
+ * it is called every time the library is going to wait for the other side
+ *
+ * @param param user parameter
+ */
+typedef void (*ymodem_flush_t)(void *param);
+
+/**
+ * @brief current time
+ *
+ * @param param user parameter
+ * @return free running millisecond counter (it may wrap around)
+ */
+typedef uint32_t (*ymodem_getTime_t)(void *param);
+
 
 typedef struct ymodem_desc ymodem_desc_t;
+typedef struct ymodem_tx_desc ymodem_tx_desc_t;
+
+/**
+ * @brief status of a receiving session
+ *
+ * once the session is over it holds the same value ymodem_receive() returns
+ */
+typedef enum
+{
+    ymRxStatus_busy = -1, /* session in progress */
+    ymRxStatus_ok = 0, /* batch received */
+    ymRxStatus_error = 1, /* session aborted (by us or by the sender) */
+}ymodem_rxStatus_t;
+
+/**
+ * @brief receiving mode
+ */
+typedef enum
+{
+    ymMode_crc, /* YMODEM: every block is acknowledged (receiver sends 'C'), errors are recovered */
+    ymMode_g, /* YMODEM-g: sender streams blocks without waiting ACKs (receiver sends 'G'),
+                 the first error aborts the session. Only for error free links (USB CDC, pty, TCP...) */
+}ymodem_mode_t;
+
+/**
+ * @brief timing parameters
+ *
+ * with minTimeout set the receiver derives its waits from the times it measures (reply to
+ * next block, gaps between the bytes of a block): they go from minTimeout up to pktTimeout and
+ * charTimeout. A wait expiring before its ceiling is not counted as a retry, the next one is
+ * twice as long, so a slow sender costs some NAKs but never the session.
+ *
+ * After a broken block the receiver drops bytes until the line has been quiet for purgeGap
+ * (or the char wait, if shorter), then it NAKs: the rest of the frame is not taken for
+ * garbage packets, each one NAKed. Only in stop and wait YMODEM, with a window garbage is
+ * skipped until the next header, YMODEM-g aborts anyway.
+ *
+ * While waiting for a file the receiver asks for it again ('C' or 'G') after pollInterval, then
+ * after twice the previous wait, up to pktTimeout: a sender starting late, or a lost request,
+ * costs about as much as the sender took to start. These waits are not counted as retries, the
+ * receiver gives up startTimeout after the first request
+ */
+typedef struct ymodem_timing
+{
+    uint32_t pktTimeout; /* ms waiting for a block (for a reply, by the sender), ceiling of the adaptive wait */
+    uint32_t charTimeout; /* ms between two bytes of a block, ceiling of the adaptive wait */
+    uint32_t minTimeout; /* ms, floor of the adaptive waits, 0 to keep the waits fixed */
+    uint32_t purgeGap; /* ms of quiet line ending the purge after a broken block, 0 to NAK at once */
+    uint32_t pollInterval; /* ms before asking for a file the second time, 0 to always wait pktTimeout */
+    uint32_t startTimeout; /* ms waiting for the sender to start a file, 0 to give up after maxRetry waits */
+    uint8_t maxRetry; /* consecutive failures before giving up */
+}ymodem_timing_t;
+
+/* default timing, the minimal RAM profile (YM_RX_MIN_RAM) keeps it fixed */
+#ifndef YM_PKT_TIMEOUT_MS
+#define YM_PKT_TIMEOUT_MS          (10000)
+#endif
+#ifndef YM_CHAR_TIMEOUT_MS
+#define YM_CHAR_TIMEOUT_MS         (1000)
+#endif
+#ifndef YM_PURGE_GAP_MS
+#define YM_PURGE_GAP_MS            (100)
+#endif
+#ifndef YM_POLL_INTERVAL_MS
+#define YM_POLL_INTERVAL_MS        (1000)
+#endif
+#ifndef YM_START_TIMEOUT_MS
+#define YM_START_TIMEOUT_MS        (60000)
+#endif
+#ifndef YM_MAX_RETRY
+#define YM_MAX_RETRY               (5)
+#endif
+
+/**
+ * @brief counters of the receiver
+ *
+ * kept whatever the logging (unless YM_RX_STATS is 0), and cleared when a session starts. Errors are counted
+ * when they are detected: in stop and wait each one costs a NAK, or a request again while
+ * waiting for a file. Times are in ms of the clock driving the receiver: ymodem_receive()
+ * needs getTime (see ymodem_set_timing()) to measure them
+ */
+typedef struct ymodem_stats
+{
+    uint32_t files; /* files received whole */
+    uint32_t blocks; /* data blocks passed to the user */
+    uint32_t bytes; /* file bytes passed to the user */
+    uint32_t timeouts; /* nothing arrived, or a block stopped halfway (sender not started yet excluded) */
+    uint32_t crcErrors; /* blocks with a bad crc */
+    uint32_t headerErrors; /* garbage where a block should start, bad block number complement */
+    uint32_t seqErrors; /* blocks with an unexpected number */
+    uint32_t duplicates; /* blocks received again after a lost ACK, ACKed and discarded */
+    uint32_t cancels; /* sessions cancelled by the sender */
+    uint32_t retries; /* failures counted against maxRetry */
+    uint32_t fileRetries; /* of them, while receiving the data of the current (or last) file */
+    uint32_t fileTime; /* from block 0 to EOT of the last file, or to the last block of the current one */
+}ymodem_stats_t;
+
+/**
+ * @brief phases of a data block, timed with YM_RX_PROFILE
+ */
+typedef enum
+{
+    ymPhase_wait,       /* from our reply (or request) to the first byte of the block */
+    ymPhase_payload,    /* from the first byte of the block to the last one (crc included) */
+    ymPhase_crc,        /* computing the crc, with the copy into the block buffer when bytes are pushed */
+    ymPhase_store,      /* passing the block to the user (processData, or releaseBlockBuffer) */
+    ymPhase_turnaround, /* from the last byte of the block to its reply sent (store included) */
+    ymPhase_count
+}ymodem_phase_t;
+
+/* bins of a phase histogram */
+#define YM_PROF_BINS               (32)
+
+/**
+ * @brief per phase log2 histograms of the data blocks
+ *
+ * times are in ticks of ymodem_port_ticks(): a phase lasting t ticks is counted in bin
+ * 0 when t is 0, in bin n when t is in [2^(n-1), 2^n) otherwise (bin 31 takes the longer ones)
+ */
+typedef struct ymodem_profile
+{
+    uint32_t hist[ymPhase_count][YM_PROF_BINS];
+}ymodem_profile_t;
+
+/* default timing: fixed waits */
+#define YM_TIMING_DEFAULT          { YM_PKT_TIMEOUT_MS, YM_CHAR_TIMEOUT_MS, 0, YM_PURGE_GAP_MS, YM_POLL_INTERVAL_MS, YM_START_TIMEOUT_MS, YM_MAX_RETRY }
 
 #ifndef YM_FILE_NAME_LENGTH
 #define YM_FILE_NAME_LENGTH        (256)
 #endif
 
-#define ROUND_UP_MULTIPLE_OF_4(x) (((x) + 3) & ~3)
-#define ROUND_UP_MULTIPLE_OF_8(x) (((x) + 7) & ~7)
+/*
+ * largest data block accepted: 1024 is the standard YMODEM one.
+ * A power of two up to 32768 enables extended blocks: a sender supporting them
+ * (like ymodem_send() of this library) advertises them in block 0 and the block
+ * size is negotiated per file, standard senders keep on using 128/1024 bytes blocks
+ */
+#ifndef YM_MAX_BLOCK_SIZE
+#define YM_MAX_BLOCK_SIZE          (1024)
+#endif
+
+/*
+ * largest number of blocks in flight: 1 is the standard YMODEM stop and wait.
+ * A power of two up to 32 enables windowed transfers: a sender supporting them
+ * (like ymodem_send() of this library) advertises them in block 0, the window is
+ * negotiated per file, blocks are ACKed/NAKed by number and only damaged blocks
+ * are sent again. The receiver keeps YM_WINDOW_MAX blocks, the sender as many frames
+ */
+#ifndef YM_WINDOW_MAX
+#define YM_WINDOW_MAX              (1)
+#endif
+
+/*
+ * set to 1 to let the receiver store a block while it receives the next one: a second
+ * block buffer is needed (a window has already more than one), see ymodem_set_async_commit()
+ */
+#ifndef YM_RX_ASYNC_COMMIT
+#define YM_RX_ASYNC_COMMIT         (0)
+#endif
+
+/*
+ * set to 1 to build the receiver without its data block buffer: data blocks are received
+ * straight into buffers provided by the user (see ymodem_set_block_buffers(), mandatory),
+ * only block 0 is kept inside, and it has to fit 128 bytes. No window
+ */
+#ifndef YM_RX_ZERO_COPY
+#define YM_RX_ZERO_COPY            (0)
+#endif
 
-/* sed struct dimension depending on platform */
-#if UINTPTR_MAX == 0xFFFFFFFF
-#define STATIC_YAYM_BUFF_SZ 1060 + ROUND_UP_MULTIPLE_OF_4(YM_FILE_NAME_LENGTH) /* for 32-bit platforms */
-#elif UINTPTR_MAX == 0xFFFFFFFFFFFFFFFF
-#define STATIC_YAYM_BUFF_SZ 1096 + ROUND_UP_MULTIPLE_OF_8(YM_FILE_NAME_LENGTH) /* for 64-bit platforms */
+/*
+ * set to 1 for the minimal RAM profile (bootloaders): the receiver has neither the data block
+ * buffer nor the file name one. Block 0 has to fit 128 bytes and it is parsed in place, data
+ * bytes are passed to processData in chunks of 128 bytes while the block is arriving: they are
+ * provisional until the block has been checked, the rollback callback discards the ones of a
+ * damaged block (see ymodem_set_rollback(), mandatory unless block buffers are used). No window.
+ * Waits are fixed at build time (YM_PKT_TIMEOUT_MS, YM_CHAR_TIMEOUT_MS, YM_PURGE_GAP_MS, YM_MAX_RETRY),
+ * not adaptive, a purge ends after a frame worth of bytes instead of after pktTimeout, and the
+ * waits for block 0 are pktTimeout long, counted as retries (no pollInterval nor startTimeout)
+ */
+#ifndef YM_RX_MIN_RAM
+#define YM_RX_MIN_RAM              (0)
+#endif
+
+/*
+ * set to 1 to bind transport and storage at compile time: ymodem_port.h has to provide
+ * ymodem_port_getBytes(), ymodem_port_putBytes(), ymodem_port_flush() and
+ * ymodem_port_processData(), with the same prototypes as the callbacks, as static inline
+ * functions (or macros) so they are inlined into the protocol engine. The getByte, getBytes,
+ * putByte, putBytes, flush and processData callbacks passed at initialization are not used
+ */
+#ifndef YM_PORT_BOUND
+#define YM_PORT_BOUND              (0)
+#endif
+
+/*
+ * set to 1 to time the phases of every data block received (see ymodem_phase_t) into
+ * log2 histograms, read by ymodem_get_profile(). ymodem_port.h has to provide
+ * uint32_t ymodem_port_ticks(void), a free running counter (eg. a cycle counter).
+ * With 0 there is no hook left in the receiver
+ */
+#ifndef YM_RX_PROFILE
+#define YM_RX_PROFILE              (0)
+#endif
+
+/*
+ * set to 0 to build the receiver without its counters (ymodem_stats_t, ymodem_get_stats()):
+ * 52 bytes less in the handle. Off by default in the minimal RAM profile
+ */
+#ifndef YM_RX_STATS
+#define YM_RX_STATS                (!(YM_RX_MIN_RAM))
+#endif
+
+/* block buffers kept by the receiver: the window, or two for asynchronous commit */
+#define YM_RX_BLOCKS               ((YM_RX_ZERO_COPY) || (YM_RX_MIN_RAM) ? 1 : (YM_WINDOW_MAX) > 1 ? (YM_WINDOW_MAX) : ((YM_RX_ASYNC_COMMIT) ? 2 : 1))
+
+/* size of every receiver block buffer */
+#define YM_RX_BLOCK_BUFFER_SIZE    ((YM_RX_ZERO_COPY) || (YM_RX_MIN_RAM) ? 128 : (YM_MAX_BLOCK_SIZE))
+
+/* frames kept by the sender: the window, and at least the one being sent and the next one */
+#define YM_TX_FRAMES               ((YM_WINDOW_MAX) > 2 ? (YM_WINDOW_MAX) : 2)
+
+/* transport callbacks, shared by receiver and sender (internal, in the field lists below) */
+typedef struct ymodem_io
+{
+    ymodem_getByte_t getByte;
+    ymodem_getBytes_t getBytes;
+    ymodem_putByte_t putByte;
+    ymodem_putBytes_t putBytes;
+    ymodem_flush_t flush;
+}ymodem_io_t;
+
+/* smoothed time and its mean deviation, scaled like TCP does: srtt x8, rttvar x4 (internal) */
+typedef struct ymodem_rtt
+{
+    uint32_t srtt; /* UINT32_MAX until the first sample */
+    uint32_t rttvar;
+}ymodem_rtt_t;
+
+/*
+ * fields of the receiver handle, F(type, name, array dimensions): the library builds its private
+ * structure from this list and staticYmodem_t below from the same one, so the two can't drift.
+ * Fields depending on the configuration are in the lists expanded here, empty when compiled out
+ */
+#if !YM_RX_MIN_RAM
+#define YM_RX_FIELDS_FILENAME(F) \
+    F(char, filename, [YM_FILE_NAME_LENGTH]) /* buffer for filenames */
+#else
+#define YM_RX_FIELDS_FILENAME(F)
+#endif
+
+/* runtime timing and the estimators of the adaptive waits, the minimal RAM profile has fixed waits */
+#if !YM_RX_MIN_RAM
+#define YM_RX_FIELDS_TIMING(F) \
+    F(uint32_t, pktTimeout, ) \
+    F(uint32_t, charTimeout, ) \
+    F(uint32_t, minTimeout, ) /* 0: fixed waits */ \
+    F(uint32_t, waitStart, ) /* time (ms) the current wait for a packet started, after our reply */ \
+    F(uint32_t, lastByteAt, ) /* time (ms) the last bytes arrived */ \
+    F(ymodem_rtt_t, rtt, ) /* reply to first byte of the next packet */ \
+    F(ymodem_rtt_t, gap, ) /* between the bytes of a packet */ \
+    F(uint32_t, purgeGap, ) /* 0: broken packets are NAKed at once */ \
+    F(uint32_t, purgeUntil, ) /* time (ms) at which the purge ends even if the line is not quiet */ \
+    F(uint32_t, pollInterval, ) /* 0: waits for block 0 are pktTimeout long */ \
+    F(uint32_t, startTimeout, ) /* 0: waits for block 0 are counted as retries */ \
+    F(uint32_t, pktWait, ) /* length of the current wait for a packet */ \
+    F(uint32_t, startUntil, ) /* time (ms) at which we stop asking for the next file */
+#define YM_RX_FIELDS_ADAPTIVE(F) \
+    F(uint8_t, maxRetry, ) \
+    F(uint8_t, adaptive, ) /* waits are derived from the measured times (when ymodem_rx_adaptive()) */ \
+    F(uint8_t, backoff, ) /* adaptive waits expired in a row, each one doubles the next wait */ \
+    F(uint8_t, rttArmed, ) /* the current wait for a packet gives an rtt sample */ \
+    F(uint8_t, freeRetry, ) /* the wait expired before its ceiling: the failure is not counted */
+#else
+#define YM_RX_FIELDS_TIMING(F)
+#define YM_RX_FIELDS_ADAPTIVE(F)
+#endif
+
+#if YM_RX_STATS
+#define YM_RX_FIELDS_STATS(F) \
+    F(uint32_t, fileStart, ) /* time (ms) block 0 of the current file has been accepted */ \
+    F(ymodem_stats_t, stats, )
 #else
-#error "Unknown platform"
+#define YM_RX_FIELDS_STATS(F)
 #endif
 
-#define ALIGNMENT (__SIZEOF_POINTER__)
+#if YM_RX_PROFILE
+#define YM_RX_FIELDS_PROFILE(F) \
+    F(uint32_t, profWait, ) /* ticks at which the wait for the current packet started */ \
+    F(uint32_t, profPkt, ) /* ticks at which the first byte of the current packet arrived */ \
+    F(uint32_t, profCrc, ) /* ticks spent on the crc of the current packet so far */ \
+    F(uint32_t, profReply, ) /* ticks at which the last byte of the current packet arrived */ \
+    F(ymodem_profile_t, prof, )
+#else
+#define YM_RX_FIELDS_PROFILE(F)
+#endif
+
+#define YM_RX_FIELDS(F) \
+    F(uint8_t, data, [YM_RX_BLOCKS][YM_RX_BLOCK_BUFFER_SIZE]) /* buffers for blocks, one per slot (window, or block being committed) */ \
+    YM_RX_FIELDS_FILENAME(F) \
+    F(ptrdiff_t, filesize, ) /* -1 if unknown */ \
+    F(ptrdiff_t, bytesRecved, ) /* file bytes received */ \
+    F(void *, cbParam, ) /* parameter to pass to the callbacks */ \
+    /* callbacks */ \
+    F(ymodem_maxFileSize_t, maxFileSize, ) \
+    F(ymodem_receiveStart_t, receiveStart, ) \
+    F(ymodem_processData_t, processData, ) \
+    F(ymodem_receiveEnd_t, receiveEnd, ) \
+    F(ymodem_commitWait_t, commitWait, ) /* NULL: processData stores synchronously */ \
+    F(ymodem_acquireBlockBuffer_t, acquireBlockBuffer, ) /* NULL: blocks are received into data */ \
+    F(ymodem_releaseBlockBuffer_t, releaseBlockBuffer, ) \
+    F(ymodem_rollback_t, rollback, ) \
+    F(ymodem_getTime_t, getTime, ) /* NULL: ymodem_receive() uses a virtual clock */ \
+    F(ymodem_io_t, io, ) \
+    /* timing */ \
+    YM_RX_FIELDS_TIMING(F) \
+    /* receiver state machine */ \
+    F(uint8_t *, pktDst, ) /* where the data bytes of the current packet are stored */ \
+    F(uint32_t, deadline, ) /* time (ms) at which the current wait expires */ \
+    F(uint32_t, held, ) /* window slots holding a verified block, waiting for the missing ones before it */ \
+    F(uint32_t, naked, ) /* window slots whose missing block has been NAKed */ \
+    YM_RX_FIELDS_STATS(F) \
+    YM_RX_FIELDS_PROFILE(F) \
+    F(uint16_t, slotLen, [YM_RX_BLOCKS]) /* data length of the held blocks */ \
+    F(uint16_t, pktLen, ) /* data length of the packet being received */ \
+    F(uint16_t, pktIdx, ) /* bytes of the current packet field received so far */ \
+    F(uint16_t, pktStore, ) /* data bytes of the current packet stored at pktDst, the following ones are only checked */ \
+    F(uint16_t, pktBase, ) /* data byte of the current packet stored at pktDst[0] (chunks) */ \
+    F(uint16_t, pktFile, ) /* data bytes of the current packet belonging to the file (chunks) */ \
+    F(uint8_t, hdr, [2]) /* block number and its complement */ \
+    F(uint8_t, trl, [2]) /* received crc */ \
+    F(uint16_t, crc, ) /* crc of the data bytes received so far (crc16_xmodem_t) */ \
+    F(uint8_t, pktState, ) /* pktSTATE_t */ \
+    F(uint8_t, rxState, ) /* rxSTATE_t */ \
+    F(uint8_t, expectedPacket, ) /* next data block number */ \
+    F(uint8_t, retryCount, ) /* consecutive failures */ \
+    YM_RX_FIELDS_ADAPTIVE(F) \
+    F(uint8_t, mode, ) /* ymodem_mode_t */ \
+    F(uint8_t, extShift, ) /* log2 of extended block size negotiated for the current file, 0 if none */ \
+    F(uint8_t, window, ) /* blocks in flight negotiated for the current file, 1 is stop and wait */ \
+    F(uint8_t, windowMax, ) /* largest window accepted */ \
+    F(uint8_t, shiftMax, ) /* log2 of the largest block accepted */ \
+    F(uint8_t, pktSlot, ) /* slot receiving the current packet */ \
+    F(uint8_t, commitPending, ) /* a commit has been started and not waited yet */ \
+    F(uint8_t, pktAcquired, ) /* pktDst has been got from acquireBlockBuffer */ \
+    F(uint8_t, pktStreamed, ) /* data bytes of the current packet are passed to processData in chunks */ \
+    F(int8_t, status, ) /* ymodem_rxStatus_t */
+
+/* fields of the sender handle, like YM_RX_FIELDS */
+#define YM_TX_FIELDS(F) \
+    F(uint8_t, frame, [YM_TX_FRAMES][YM_MAX_BLOCK_SIZE + 5]) /* frames (header, data block, crc) in flight and the next one, a ring with a window */ \
+    F(void *, cbParam, ) /* parameter to pass to the callbacks */ \
+    /* callbacks */ \
+    F(ymodem_sendStart_t, sendStart, ) \
+    F(ymodem_readData_t, readData, ) \
+    F(ymodem_sendEnd_t, sendEnd, ) \
+    F(ymodem_getTime_t, getTime, ) /* NULL: each reply not ACKing the oldest block in flight counts as charTimeout of its wait */ \
+    F(ymodem_io_t, io, ) \
+    /* timing, fixed */ \
+    F(uint32_t, pktTimeout, ) \
+    F(uint32_t, charTimeout, ) \
+    /* sender state */ \
+    F(uint16_t, frameLen, [YM_TX_FRAMES]) /* length of the frames, 0 if there is no frame */ \
+    F(uint32_t, ackMin, ) /* fastest ACK of a stop and wait data block, ms from its sending (0: unknown) */ \
+    F(uint8_t, cur, ) /* index of the frame being sent (the oldest one not ACKed with a window) */ \
+    F(uint8_t, blkShift, ) /* log2 of the data block size for the current file */ \
+    F(uint8_t, window, ) /* blocks in flight for the current file, 1 is stop and wait */ \
+    F(uint8_t, mode, ) /* ymodem_mode_t, chosen by the receiver */ \
+    F(uint8_t, maxRetry, )
 
-typedef struct __attribute__((aligned(ALIGNMENT))) staticYmodem
+/* a field of the public storage: same type and place, not to be used */
+#define YM_FIELD_DUMMY(type, name, dim) type dummy_##name dim;
+
+/* storage for the receiver handle: the private structure has the same fields, its size follows the configuration */
+typedef struct staticYmodem
 {
-    uint8_t dummy[STATIC_YAYM_BUFF_SZ];
+    YM_RX_FIELDS(YM_FIELD_DUMMY)
 }staticYmodem_t;
 
+/* storage for the sender handle */
+typedef struct staticYmodemTx
+{
+    YM_TX_FIELDS(YM_FIELD_DUMMY)
+}staticYmodemTx_t;
+
+#define STATIC_YAYM_BUFF_SZ        (sizeof(staticYmodem_t))
+#define STATIC_YAYM_TX_BUFF_SZ     (sizeof(staticYmodemTx_t))
+
 /**
  * @brief initialization function
  * 
@@ -109,14 +607,243 @@ typedef struct __attribute__((aligned(ALIGNMENT))) staticYmodem
  * @param cbParam user parameter to be passed to callbacks
  * @param maxFileSize callback
  * @param receiveStart callback
- * @param processData callback
+ * @param processData callback (can be NULL with YM_RX_ZERO_COPY), with YM_RX_MIN_RAM it gets provisional chunks
  * @param receiveEnd callback
- * @param getByte callback
- * @param putByte callback
+ * @param getByte callback, can be NULL if getBytes is provided (both can be NULL if only the non-blocking API is used)
+ * @param getBytes optional callback (can be NULL), when provided it is used instead of getByte
+ * @param putByte callback, can be NULL if putBytes is provided
+ * @param putBytes optional callback (can be NULL), when provided it is used instead of putByte
+ * @param flush optional callback (can be NULL)
  * @return pointer to ymodem handle, or NULL on error 
  */
-ymodem_desc_t *ymodem_init(staticYmodem_t *staticYmBuffer, void *cbParam, ymodem_maxFileSize_t maxFileSize, ymodem_receiveStart_t receiveStart, ymodem_processData_t processData, ymodem_receiveEnd_t receiveEnd, ymodem_getByte_t getByte, ymodem_putByte_t putByte);
+ymodem_desc_t *ymodem_init(staticYmodem_t *staticYmBuffer, void *cbParam, ymodem_maxFileSize_t maxFileSize, ymodem_receiveStart_t receiveStart, ymodem_processData_t processData, ymodem_receiveEnd_t receiveEnd, ymodem_getByte_t getByte, ymodem_getBytes_t getBytes, ymodem_putByte_t putByte, ymodem_putBytes_t putBytes, ymodem_flush_t flush);
+
+/**
+ * @brief select the receiving mode
+ *
+ * default mode is ymMode_crc. It can be changed before starting every session
+ * (ymodem_receive() or ymodem_rx_start())
+ *
+ * @param ymHdl ymodem handle
+ * @param mode receiving mode
+ */
+void ymodem_set_mode(ymodem_desc_t *ymHdl, ymodem_mode_t mode);
+
+/**
+ * @brief set the largest window accepted by the receiver
+ *
+ * default is YM_WINDOW_MAX. The window is used only with senders supporting
+ * windowed transfers, and never in YMODEM-g mode
+ *
+ * @param ymHdl ymodem handle
+ * @param window blocks in flight, from 1 (stop and wait) to YM_WINDOW_MAX
+ */
+void ymodem_set_window(ymodem_desc_t *ymHdl, uint8_t window);
+
+/**
+ * @brief set the largest block accepted by the receiver
+ *
+ * default is YM_MAX_BLOCK_SIZE. Extended blocks are used only with senders supporting them
+ *
+ * @param ymHdl ymodem handle
+ * @param blockSize largest block, rounded down to a power of two from 1024 to YM_MAX_BLOCK_SIZE
+ */
+void ymodem_set_block_size(ymodem_desc_t *ymHdl, size_t blockSize);
+
+/**
+ * @brief set the timing of the receiver
+ *
+ * default is YM_TIMING_DEFAULT. Adaptive waits are used only for stop and wait data blocks in
+ * YMODEM mode: block 0 waits for the user to start the sender, with a window or in YMODEM-g the
+ * sender doesn't wait for our replies. ymodem_receive() needs getTime to measure times (without
+ * it the waits stay fixed), the non-blocking API gets the time from its caller. With YM_RX_MIN_RAM
+ * only getTime is taken, pktTimeout, charTimeout, purgeGap and maxRetry are fixed at build time, minTimeout,
+ * pollInterval and startTimeout are not used
+ *
+ * @param ymHdl ymodem handle
+ * @param timing timing parameters, copied
+ * @param getTime optional callback (can be NULL), clock of ymodem_receive()
+ */
+void ymodem_set_timing(ymodem_desc_t *ymHdl, const ymodem_timing_t *timing, ymodem_getTime_t getTime);
+
+/**
+ * @brief enable asynchronous commit
+ *
+ * processData is allowed to return as soon as the commit of the block has started
+ * (eg. a flash program or a DMA transfer has been started, a writer thread has been
+ * woken up), the buffer stays untouched until commitWait is called for it.
+ * The block is ACKed right away, so the sender goes on while storage works. Only one
+ * commit is in progress at a time: commitWait is called before the next processData
+ * and at the end of the file, a failure reported by commitWait aborts the session.
+ * With a window every commit is waited right away.
+ *
+ * @param ymHdl ymodem handle
+ * @param commitWait callback, NULL to go back to synchronous processData
+ * @return 0 on success, -1 if the library has been built with a single block buffer (YM_RX_BLOCKS)
+ */
+int ymodem_set_async_commit(ymodem_desc_t *ymHdl, ymodem_commitWait_t commitWait);
+
+/**
+ * @brief receive data blocks straight into buffers provided by the user
+ *
+ * when the header of the expected data block arrives, acquireBlockBuffer is asked where
+ * to put its bytes; once the block has been checked the buffer is given back with
+ * releaseBlockBuffer, and processData is not called. Block 0, duplicates and padding
+ * after the end of the file are still handled inside. The window is not used.
+ * It can be changed before starting every session.
+ *
+ * @param ymHdl ymodem handle
+ * @param acquireBlockBuffer callback, NULL to go back to processData (not allowed with YM_RX_ZERO_COPY)
+ * @param releaseBlockBuffer callback
+ */
+void ymodem_set_block_buffers(ymodem_desc_t *ymHdl, ymodem_acquireBlockBuffer_t acquireBlockBuffer, ymodem_releaseBlockBuffer_t releaseBlockBuffer);
+
+/**
+ * @brief set the callback discarding provisional data (YM_RX_MIN_RAM)
+ *
+ * @param ymHdl ymodem handle
+ * @param rollback callback
+ */
+void ymodem_set_rollback(ymodem_desc_t *ymHdl, ymodem_rollback_t rollback);
 
+/**
+ * @brief receive a batch of files
+ *
+ * blocking function: it returns when the whole batch is received or the session is aborted.
+ * Timeouts are implemented by the getByte/getBytes callbacks.
+ *
+ * @param ymHdl ymodem handle
+ * @return 0 on success, 1 on error
+ */
 int ymodem_receive(ymodem_desc_t *ymHdl);
 
+/**
+ * @brief start a non-blocking receiving session
+ *
+ * Non-blocking API: the user pushes received bytes with ymodem_rx_feed() and periodically calls
+ * ymodem_rx_poll() to let the library handle timeouts. Time is a free running millisecond counter
+ * supplied by the user (it may wrap around). getByte/getBytes callbacks are not used.
+ *
+ * @param ymHdl ymodem handle
+ * @param now_ms current time in ms
+ * @return session status
+ */
+ymodem_rxStatus_t ymodem_rx_start(ymodem_desc_t *ymHdl, uint32_t now_ms);
+
+/**
+ * @brief push received bytes into the session
+ *
+ * all bytes are consumed, bytes received after the end of the session are discarded
+ *
+ * @param ymHdl ymodem handle
+ * @param buf received bytes
+ * @param len number of bytes in buf
+ * @param now_ms current time in ms
+ * @return session status
+ */
+ymodem_rxStatus_t ymodem_rx_feed(ymodem_desc_t *ymHdl, const uint8_t *buf, size_t len, uint32_t now_ms);
+
+/**
+ * @brief handle timeouts
+ *
+ * @param ymHdl ymodem handle
+ * @param now_ms current time in ms
+ * @return session status
+ */
+ymodem_rxStatus_t ymodem_rx_poll(ymodem_desc_t *ymHdl, uint32_t now_ms);
+
+/**
+ * @brief time left before ymodem_rx_poll() has something to do
+ *
+ * useful to compute the timeout of select()/epoll_wait() or to program a timer
+ *
+ * @param ymHdl ymodem handle
+ * @param now_ms current time in ms
+ * @return ms to wait, 0 if a timeout is already expired
+ */
+uint32_t ymodem_rx_timeout(const ymodem_desc_t *ymHdl, uint32_t now_ms);
+
+/**
+ * @brief abort the session in progress
+ *
+ * for a transport error noticed by the user: the file being received (if any) is closed, the
+ * sender is asked to abort and the session ends with ymRxStatus_error
+ *
+ * @param ymHdl ymodem handle
+ * @return session status
+ */
+ymodem_rxStatus_t ymodem_rx_cancel(ymodem_desc_t *ymHdl);
+
+#if YM_RX_STATS
+/**
+ * @brief read the counters of the receiver (YM_RX_STATS)
+ *
+ * they can be read while a session is going on (from the thread driving it)
+ *
+ * @param ymHdl ymodem handle
+ * @param stats where the counters are copied
+ */
+void ymodem_get_stats(const ymodem_desc_t *ymHdl, ymodem_stats_t *stats);
+#endif
+
+#if YM_RX_PROFILE
+/**
+ * @brief read the phase histograms of the receiver (YM_RX_PROFILE)
+ *
+ * they are cleared when a session starts, like the counters
+ *
+ * @param ymHdl ymodem handle
+ * @param profile where the histograms are copied
+ */
+void ymodem_get_profile(const ymodem_desc_t *ymHdl, ymodem_profile_t *profile);
+#endif
+
+/**
+ * @brief sender initialization function
+ *
+ * @param staticYmBuffer buffer used to store internal structures
+ * @param cbParam user parameter to be passed to callbacks
+ * @param sendStart callback
+ * @param readData callback
+ * @param sendEnd callback
+ * @param getByte callback, can be NULL if getBytes is provided
+ * @param getBytes optional callback (can be NULL), when provided it is used instead of getByte
+ * @param putByte callback, can be NULL if putBytes is provided
+ * @param putBytes optional callback (can be NULL), when provided it is used instead of putByte
+ * @param flush optional callback (can be NULL)
+ * @return pointer to ymodem sender handle, or NULL on error
+ */
+ymodem_tx_desc_t *ymodem_tx_init(staticYmodemTx_t *staticYmBuffer, void *cbParam, ymodem_sendStart_t sendStart, ymodem_readData_t readData, ymodem_sendEnd_t sendEnd, ymodem_getByte_t getByte, ymodem_getBytes_t getBytes, ymodem_putByte_t putByte, ymodem_putBytes_t putBytes, ymodem_flush_t flush);
+
+/**
+ * @brief send a batch of files
+ *
+ * blocking function: files are requested one by one through the sendStart callback,
+ * until it reports the end of the batch. The receiver chooses YMODEM or YMODEM-g, and
+ * extended blocks are used when the receiver accepts them.
+ * While a block is on the way, the next one is already read and framed, so the
+ * sender can go on as soon as the ACK arrives.
+ *
+ * @param ymTxHdl ymodem sender handle
+ * @return 0 on success, 1 on error
+ */
+int ymodem_send(ymodem_tx_desc_t *ymTxHdl);
+
+/**
+ * @brief set the timing of the sender
+ *
+ * default is YM_TIMING_DEFAULT, the sender waits are fixed (minTimeout is not used). With a
+ * window the oldest block not ACKed is sent again pktTimeout after it was last sent, whatever
+ * arrives meanwhile: getTime measures it, without it every reply read counts as charTimeout
+ *
+ * @param ymTxHdl ymodem sender handle
+ * @param timing timing parameters, copied
+ * @param getTime optional callback (can be NULL), called with the cbParam of ymodem_tx_init()
+ */
+void ymodem_tx_set_timing(ymodem_tx_desc_t *ymTxHdl, const ymodem_timing_t *timing, ymodem_getTime_t getTime);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif /* YMODEM_SRC_YMODEM_H */
@@ -0,0 +1,253 @@
+/*
+ * Copyright 2024 Massimiliano Cialdi
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef YMODEM_SRC_YMODEM_HPP
+#define YMODEM_SRC_YMODEM_HPP
+
+/*
+ * C++17 front-end: receiver and sender as templates over transport and storage policy
+ * types, no void pointers nor casts on the user side. It is a typed wrapper over the C
+ * callbacks, it doesn't make the engine any faster.
+ * The protocol engine is the C one, built as usual (CRC backend chosen by the include path,
+ * YM_MAX_BLOCK_SIZE, YM_WINDOW_MAX...), the C API is unchanged.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include "ymodem.h"
+
+#if YM_PORT_BOUND
+#error "the C++ front-end binds transport and storage by itself, build the engine without YM_PORT_BOUND"
+#endif
+
+namespace ymodem
+{
+
+/**
+ * @brief receiver with transport and storage bound at compile time
+ *
+ * Transport has to provide:
+ * - std::int32_t read(std::uint8_t *buf, std::size_t len, std::uint32_t toutMs): it returns
+ *   as soon as at least one byte is available (like read() does), 0 on timeout, negative
+ *   on error (see ymodem_getBytes_t)
+ * - void write(const std::uint8_t *buf, std::size_t len): may buffer until flush()
+ * - void flush()
+ *
+ * Storage has to provide:
+ * - std::size_t maxFileSize()
+ * - bool open(const char *filename)
+ * - bool write(const std::uint8_t *data, std::size_t len)
+ * - void close()
+ *
+ * The engine still reaches the policies through its callback pointers, each one a static
+ * trampoline calling the policy method: the templates add type safety (no void pointers nor
+ * casts on the user side), not speed, and the CRC backend is the one the engine is built
+ * with. To have the transport inlined into the engine use the C API built with YM_PORT_BOUND.
+ *
+ * @tparam BlockSize largest block accepted, from 1024 up to YM_MAX_BLOCK_SIZE
+ */
+template <class Transport, class Storage, std::size_t BlockSize = YM_MAX_BLOCK_SIZE>
+class Receiver
+{
+    static_assert((BlockSize >= 1024) && (BlockSize <= YM_MAX_BLOCK_SIZE) && (0 == (BlockSize & (BlockSize - 1))),
+                  "BlockSize must be a power of two from 1024 to YM_MAX_BLOCK_SIZE");
+
+public:
+    Receiver(Transport &transport, Storage &storage) : transport_(transport), storage_(storage)
+    {
+        hdl_ = ymodem_init(&staticYmBuff_, this, maxFileSize, receiveStart, processData, receiveEnd,
+                           nullptr, getBytes, nullptr, putBytes, flush);
+        ymodem_set_block_size(hdl_, BlockSize);
+    }
+
+    /* the engine keeps a pointer to the receiver */
+    Receiver(const Receiver &) = delete;
+    Receiver &operator=(const Receiver &) = delete;
+
+    /** @brief see ymodem_set_mode() */
+    void setMode(ymodem_mode_t mode)
+    {
+        ymodem_set_mode(hdl_, mode);
+    }
+
+    /** @brief see ymodem_set_window() */
+    void setWindow(std::uint8_t window)
+    {
+        ymodem_set_window(hdl_, window);
+    }
+
+    /**
+     * @brief receive a batch of files
+     *
+     * blocking, like ymodem_receive()
+     *
+     * @return true if the whole batch has been received
+     */
+    bool receive()
+    {
+        return 0 == ymodem_receive(hdl_);
+    }
+
+#if YM_RX_STATS
+    /** @brief counters of the last (or current) session, see ymodem_get_stats() */
+    ymodem_stats_t stats() const
+    {
+        ymodem_stats_t s;
+        ymodem_get_stats(hdl_, &s);
+        return s;
+    }
+#endif
+
+    /** @brief the C handle, for the rest of the C API */
+    ymodem_desc_t *handle()
+    {
+        return hdl_;
+    }
+
+private:
+    static Receiver &self(void *param)
+    {
+        return *static_cast<Receiver *>(param);
+    }
+
+    static std::size_t maxFileSize(void *param)
+    {
+        return self(param).storage_.maxFileSize();
+    }
+
+    static std::int32_t receiveStart(void *param, const char *filename)
+    {
+        return self(param).storage_.open(filename) ? 0 : -1;
+    }
+
+    static std::int32_t processData(void *param, const std::uint8_t *buffer, std::size_t buffSz)
+    {
+        return self(param).storage_.write(buffer, buffSz) ? 0 : -1;
+    }
+
+    static std::int32_t receiveEnd(void *param)
+    {
+        self(param).storage_.close();
+        return 0;
+    }
+
+    static std::int32_t getBytes(void *param, std::uint8_t *buf, std::size_t len, std::uint32_t tout)
+    {
+        static_assert(std::is_signed_v<decltype(self(param).transport_.read(buf, len, tout))>,
+                      "Transport::read has to return a signed count, negative on error");
+        return self(param).transport_.read(buf, len, tout);
+    }
+
+    static void putBytes(void *param, const std::uint8_t *buf, std::size_t len)
+    {
+        self(param).transport_.write(buf, len);
+    }
+
+    static void flush(void *param)
+    {
+        self(param).transport_.flush();
+    }
+
+    staticYmodem_t staticYmBuff_;
+    Transport &transport_;
+    Storage &storage_;
+    ymodem_desc_t *hdl_;
+};
+
+/**
+ * @brief sender with transport and file source bound at compile time
+ *
+ * Transport is the same as the Receiver one.
+ *
+ * Source has to provide:
+ * - int open(char *filename, std::size_t filenameSz, std::size_t &filesize): opens the next
+ *   file of the batch, 0 on success, 1 if there are no more files, any other value on error
+ * - std::int32_t read(std::uint8_t *buf, std::size_t len): like fread(), negative on error
+ * - void close()
+ */
+template <class Transport, class Source>
+class Sender
+{
+public:
+    Sender(Transport &transport, Source &source) : transport_(transport), source_(source)
+    {
+        hdl_ = ymodem_tx_init(&staticYmBuff_, this, sendStart, readData, sendEnd,
+                              nullptr, getBytes, nullptr, putBytes, flush);
+    }
+
+    /* the engine keeps a pointer to the sender */
+    Sender(const Sender &) = delete;
+    Sender &operator=(const Sender &) = delete;
+
+    /**
+     * @brief send a batch of files
+     *
+     * blocking, like ymodem_send()
+     *
+     * @return true if the whole batch has been sent
+     */
+    bool send()
+    {
+        return 0 == ymodem_send(hdl_);
+    }
+
+private:
+    static Sender &self(void *param)
+    {
+        return *static_cast<Sender *>(param);
+    }
+
+    static std::int32_t sendStart(void *param, char *filename, std::size_t filenameSz, std::size_t *filesize)
+    {
+        return self(param).source_.open(filename, filenameSz, *filesize);
+    }
+
+    static std::int32_t readData(void *param, std::uint8_t *buffer, std::size_t buffSz)
+    {
+        return self(param).source_.read(buffer, buffSz);
+    }
+
+    static std::int32_t sendEnd(void *param)
+    {
+        self(param).source_.close();
+        return 0;
+    }
+
+    static std::int32_t getBytes(void *param, std::uint8_t *buf, std::size_t len, std::uint32_t tout)
+    {
+        static_assert(std::is_signed_v<decltype(self(param).transport_.read(buf, len, tout))>,
+                      "Transport::read has to return a signed count, negative on error");
+        return self(param).transport_.read(buf, len, tout);
+    }
+
+    static void putBytes(void *param, const std::uint8_t *buf, std::size_t len)
+    {
+        self(param).transport_.write(buf, len);
+    }
+
+    static void flush(void *param)
+    {
+        self(param).transport_.flush();
+    }
+
+    staticYmodemTx_t staticYmBuff_;
+    Transport &transport_;
+    Source &source_;
+    ymodem_tx_desc_t *hdl_;
+};
+
+} // namespace ymodem
+
+#endif /* YMODEM_SRC_YMODEM_HPP */
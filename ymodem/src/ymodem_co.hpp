@@ -0,0 +1,322 @@
+/*
+ * Copyright 2024 Massimiliano Cialdi
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef YMODEM_SRC_YMODEM_CO_HPP
+#define YMODEM_SRC_YMODEM_CO_HPP
+
+/*
+ * C++20 coroutine front-end: the receiver suspends while it waits for bytes or for a
+ * timeout, instead of blocking the thread, so many sessions can share a few threads.
+ * It doesn't depend on any executor: the port decides where and when the receiver
+ * is resumed. The protocol engine is the C one, driven by the non-blocking API.
+ */
+
+#if __cplusplus < 202002L
+#error "ymodem_co.hpp needs C++20"
+#endif
+
+#include <chrono>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <type_traits>
+#include <utility>
+#include "ymodem.h"
+
+#if YM_PORT_BOUND
+#error "the C++ front-end binds transport and storage by itself, build the engine without YM_PORT_BOUND"
+#endif
+
+namespace ymodem
+{
+
+/**
+ * @brief lazy coroutine returning a T
+ *
+ * it starts when it is awaited (the awaiting coroutine is resumed when it ends), or
+ * when start() is called: in this case done() and result() tell when it is over.
+ */
+template <class T>
+class [[nodiscard]] Task
+{
+public:
+    struct promise_type
+    {
+        T value{};
+        std::coroutine_handle<> continuation;
+
+        Task get_return_object()
+        {
+            return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+
+        std::suspend_always initial_suspend() noexcept
+        {
+            return {};
+        }
+
+        auto final_suspend() noexcept
+        {
+            struct FinalAwaiter
+            {
+                bool await_ready() noexcept
+                {
+                    return false;
+                }
+
+                /* symmetric transfer: no stack growth when tasks await tasks */
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> h) noexcept
+                {
+                    std::coroutine_handle<> c = h.promise().continuation;
+                    return c ? c : std::noop_coroutine();
+                }
+
+                void await_resume() noexcept
+                {
+                }
+            };
+            return FinalAwaiter{};
+        }
+
+        void return_value(T v)
+        {
+            value = std::move(v);
+        }
+
+        void unhandled_exception()
+        {
+            std::terminate();
+        }
+    };
+
+    Task(Task &&other) noexcept : coro_(std::exchange(other.coro_, {}))
+    {
+    }
+
+    Task(const Task &) = delete;
+    Task &operator=(const Task &) = delete;
+
+    ~Task()
+    {
+        if(coro_)
+        {
+            coro_.destroy();
+        }
+    }
+
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+    {
+        coro_.promise().continuation = awaiting;
+        return coro_;
+    }
+
+    T await_resume()
+    {
+        return std::move(coro_.promise().value);
+    }
+
+    /** @brief run the task up to its first suspension, when it is not awaited */
+    void start()
+    {
+        coro_.resume();
+    }
+
+    /** @brief true once the task has returned */
+    bool done() const
+    {
+        return coro_.done();
+    }
+
+    /** @brief value returned by the task, valid once done() */
+    T &result()
+    {
+        return coro_.promise().value;
+    }
+
+private:
+    explicit Task(std::coroutine_handle<promise_type> coro) : coro_(coro)
+    {
+    }
+
+    std::coroutine_handle<promise_type> coro_;
+};
+
+/**
+ * @brief receiver suspending on byte and timeout waits
+ *
+ * Port has to provide:
+ * - read_some(std::uint8_t *buf, std::size_t len, std::uint32_t toutMs): returns an
+ *   awaitable resuming with the number of bytes stored into buf (std::int32_t) as soon as
+ *   at least one is available, with 0 once toutMs has elapsed, or negative on error (the
+ *   session is cancelled, see ymodem_rx_cancel())
+ * - void write(const std::uint8_t *buf, std::size_t len): may buffer until flush(), it
+ *   doesn't suspend (replies are a few bytes)
+ * - void flush()
+ *
+ * Sink is the same as the Storage of ymodem::Receiver (ymodem.hpp).
+ *
+ * A receiver serves one session at a time: its handle lives inside it.
+ *
+ * @tparam BlockSize largest block accepted, from 1024 up to YM_MAX_BLOCK_SIZE
+ */
+template <std::size_t BlockSize = YM_MAX_BLOCK_SIZE>
+class AsyncReceiver
+{
+    static_assert((BlockSize >= 1024) && (BlockSize <= YM_MAX_BLOCK_SIZE) && (0 == (BlockSize & (BlockSize - 1))),
+                  "BlockSize must be a power of two from 1024 to YM_MAX_BLOCK_SIZE");
+
+public:
+    AsyncReceiver() = default;
+
+    /* the engine keeps a pointer into the receiver */
+    AsyncReceiver(const AsyncReceiver &) = delete;
+    AsyncReceiver &operator=(const AsyncReceiver &) = delete;
+
+    /** @brief see ymodem_set_mode(), applied to the next session */
+    void setMode(ymodem_mode_t mode)
+    {
+        mode_ = mode;
+    }
+
+    /** @brief see ymodem_set_window(), applied to the next session */
+    void setWindow(std::uint8_t window)
+    {
+        window_ = window;
+    }
+
+#if YM_RX_STATS
+    /** @brief counters of the last (or current) session, see ymodem_get_stats() */
+    ymodem_stats_t stats() const
+    {
+        ymodem_stats_t s{};
+        if(nullptr != hdl_)
+        {
+            ymodem_get_stats(hdl_, &s);
+        }
+        return s;
+    }
+#endif
+
+    /**
+     * @brief receive a batch of files
+     *
+     * @return task resuming with true if the whole batch has been received
+     */
+    template <class Port, class Sink>
+    Task<bool> receive_all(Port &port, Sink &sink)
+    {
+        Binding<Port, Sink> binding{port, sink};
+
+        ymodem_desc_t *hdl = hdl_ = ymodem_init(&staticYmBuff_, &binding,
+                                         Binding<Port, Sink>::maxFileSize,
+                                         Binding<Port, Sink>::receiveStart,
+                                         Binding<Port, Sink>::processData,
+                                         Binding<Port, Sink>::receiveEnd,
+                                         nullptr, nullptr, nullptr, /* bytes are pushed with ymodem_rx_feed() */
+                                         Binding<Port, Sink>::putBytes,
+                                         Binding<Port, Sink>::flush);
+        ymodem_set_mode(hdl, mode_);
+        ymodem_set_window(hdl, window_);
+        ymodem_set_block_size(hdl, BlockSize);
+
+        std::uint32_t now = now_ms();
+        ymodem_rxStatus_t status = ymodem_rx_start(hdl, now);
+        while(ymRxStatus_busy == status)
+        {
+            auto n = co_await port.read_some(rxBuf_, sizeof(rxBuf_), ymodem_rx_timeout(hdl, now));
+            static_assert(std::is_signed_v<decltype(n)>, "read_some has to resume with a signed count, negative on error");
+            now = now_ms();
+            if(n < 0)
+            {
+                status = ymodem_rx_cancel(hdl);
+            }
+            else if(n > 0)
+            {
+                status = ymodem_rx_feed(hdl, rxBuf_, (std::size_t)n, now);
+            }
+            if(ymRxStatus_busy == status)
+            {
+                status = ymodem_rx_poll(hdl, now);
+            }
+        }
+        co_return ymRxStatus_ok == status;
+    }
+
+private:
+    /* what the engine callbacks reach, it lives in the coroutine frame */
+    template <class Port, class Sink>
+    struct Binding
+    {
+        Port &port;
+        Sink &sink;
+
+        static Binding &self(void *param)
+        {
+            return *static_cast<Binding *>(param);
+        }
+
+        static std::size_t maxFileSize(void *param)
+        {
+            return self(param).sink.maxFileSize();
+        }
+
+        static std::int32_t receiveStart(void *param, const char *filename)
+        {
+            return self(param).sink.open(filename) ? 0 : -1;
+        }
+
+        static std::int32_t processData(void *param, const std::uint8_t *buffer, std::size_t buffSz)
+        {
+            return self(param).sink.write(buffer, buffSz) ? 0 : -1;
+        }
+
+        static std::int32_t receiveEnd(void *param)
+        {
+            self(param).sink.close();
+            return 0;
+        }
+
+        static void putBytes(void *param, const std::uint8_t *buf, std::size_t len)
+        {
+            self(param).port.write(buf, len);
+        }
+
+        static void flush(void *param)
+        {
+            self(param).port.flush();
+        }
+    };
+
+    static std::uint32_t now_ms()
+    {
+        using namespace std::chrono;
+        return (std::uint32_t)duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+    }
+
+    staticYmodem_t staticYmBuff_;
+    ymodem_desc_t *hdl_ = nullptr;
+    ymodem_mode_t mode_ = ymMode_crc;
+    std::uint8_t window_ = YM_WINDOW_MAX;
+    std::uint8_t rxBuf_[BlockSize + 5]; /* a whole frame in one read */
+};
+
+} // namespace ymodem
+
+#endif /* YMODEM_SRC_YMODEM_CO_HPP */
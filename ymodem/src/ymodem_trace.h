@@ -0,0 +1,139 @@
+/*
+ * Copyright 2024 Massimiliano Cialdi
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef YMODEM_SRC_YMODEM_TRACE_H
+#define YMODEM_SRC_YMODEM_TRACE_H
+
+/*
+ * binary event trace of the receiver: fixed size records written into a ring in RAM,
+ * without formatting, so it can be left enabled in the field. The ring is dumped as it
+ * is (from a debugger, a file, a spare UART...) and decoded after the fact by test/ytrace
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* trace levels: events of a level are recorded when YM_TRACE_LEVEL is at least that */
+#define YM_TRACE_ERROR             (1) /* errors, retries and aborts */
+#define YM_TRACE_INFO              (2) /* sessions, files and recoveries */
+#define YM_TRACE_DEBUG             (3) /* every block and every reply */
+
+/*
+ * events recorded into the ring: 0 leaves no trace code in the receiver. With any other
+ * level ymodem_port.h has to provide uint32_t ymodem_port_ticks(void), the records time
+ */
+#ifndef YM_TRACE_LEVEL
+#define YM_TRACE_LEVEL             (0)
+#endif
+
+/* records kept by the ring (a power of two), the oldest ones are overwritten */
+#ifndef YM_TRACE_RECORDS
+#define YM_TRACE_RECORDS           (256)
+#endif
+
+/* first word of the ring, tells a dump and its byte order */
+#define YM_TRACE_MAGIC             (0x594d5452u) /* "YMTR" */
+
+/**
+ * @brief events of the trace
+ *
+ * values are part of the dump format: new events are added at the end
+ */
+typedef enum
+{
+    ymTrace_sessionStart,  /* INFO: arg is the mode (ymodem_mode_t) */
+    ymTrace_sessionEnd,    /* INFO: arg is the status (ymodem_rxStatus_t) */
+    ymTrace_fileStart,     /* INFO: block 0 accepted, arg is the window << 8 | log2 of the extended block size (0 if none) */
+    ymTrace_fileEnd,       /* INFO: EOT acknowledged */
+    ymTrace_block,         /* DEBUG: good data block, arg is its data length */
+    ymTrace_reply,         /* DEBUG: reply or request sent, arg is the char (ACK, NAK, C, G) */
+    ymTrace_crcError,      /* ERROR: block with a bad crc */
+    ymTrace_headerError,   /* ERROR: bad block number complement, arg is the complement */
+    ymTrace_seqError,      /* ERROR: unexpected block number, arg is the expected one */
+    ymTrace_duplicate,     /* INFO: previous block again, our ACK got lost */
+    ymTrace_garbage,       /* ERROR: unexpected char where a block should start, arg is the char */
+    ymTrace_purge,         /* INFO: the line is purged after garbage */
+    ymTrace_timeout,       /* ERROR: nothing arrived, arg is the wait in ms */
+    ymTrace_earlyTimeout,  /* INFO: an adaptive wait expired before its ceiling, arg is 1 inside a block */
+    ymTrace_truncated,     /* ERROR: a block stopped halfway, arg is the bytes of the field received */
+    ymTrace_cancel,        /* ERROR: cancelled by the sender */
+    ymTrace_abort,         /* ERROR: the receiver gives up, arg is the consecutive failures */
+    ymTrace_noSender,      /* ERROR: no sender within startTimeout */
+    ymTrace_count
+}ymodem_trace_event_t;
+
+/**
+ * @brief a record of the trace (8 bytes)
+ *
+ * blkNum is the number of the block the event refers to (the expected one when there
+ * is no block), ticks come from ymodem_port_ticks()
+ */
+typedef struct ymodem_trace_rec
+{
+    uint32_t ticks;
+    uint16_t arg;
+    uint8_t event; /* ymodem_trace_event_t */
+    uint8_t blkNum;
+}ymodem_trace_rec_t;
+
+/**
+ * @brief the ring, dumped as it is
+ *
+ * the last records written are rec[(head - n) % records], n from 1 to min(head, records)
+ */
+typedef struct ymodem_trace_ring
+{
+    uint32_t magic; /* YM_TRACE_MAGIC */
+    uint32_t records; /* YM_TRACE_RECORDS */
+    uint32_t head; /* records written so far */
+    uint32_t reserved;
+    ymodem_trace_rec_t rec[YM_TRACE_RECORDS];
+}ymodem_trace_ring_t;
+
+#if YM_TRACE_LEVEL > 0
+/**
+ * @brief record an event
+ *
+ * lock-free: a slot is reserved with an atomic increment, so sessions on other threads
+ * (or an ISR) can record into the same ring. A record being written while the ring is
+ * dumped can come out torn
+ *
+ * @param event ymodem_trace_event_t
+ * @param blkNum block number
+ * @param arg argument of the event
+ */
+void ymodem_trace(uint8_t event, uint8_t blkNum, uint16_t arg);
+
+/**
+ * @brief the ring, to be dumped
+ *
+ * @return pointer to the ring, sizeof(ymodem_trace_ring_t) bytes
+ */
+const ymodem_trace_ring_t *ymodem_trace_ring(void);
+
+/**
+ * @brief empty the ring
+ */
+void ymodem_trace_clear(void);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* YMODEM_SRC_YMODEM_TRACE_H */